@@ -0,0 +1,459 @@
+#include "arena.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+using namespace std;
+
+#define ARENA_RESPAWN_TICKS 20
+#define ARENA_SPAWN_ATTEMPTS 64
+#define ARENA_FOOD_SAMPLES 8
+#define ARENA_SNAKE_LENGTH 3
+#define ARENA_AI_GRAIN 64
+
+static uint32_t nextRandom(uint32_t& state) {
+    // xorshift32: cheap, deterministic and small enough to snapshot
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// Stateless hash so AI decisions never touch the shared generator
+static uint32_t mixBits(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+}
+
+static uint64_t chunkKey(int chunkX, int chunkY) {
+    return ((uint64_t)(uint32_t)chunkY << 32) | (uint32_t)chunkX;
+}
+
+static ArenaChunk* findChunk(const Arena& arena, int64_t cell, int& offset) {
+    int x = arenaCellX(arena, cell);
+    int y = arenaCellY(arena, cell);
+    offset = ((y & (ARENA_CHUNK_SIZE - 1)) << ARENA_CHUNK_SHIFT) | (x & (ARENA_CHUNK_SIZE - 1));
+    auto it = arena.chunks.find(chunkKey(x >> ARENA_CHUNK_SHIFT, y >> ARENA_CHUNK_SHIFT));
+    return it == arena.chunks.end() ? NULL : it->second.get();
+}
+
+static ArenaChunk* findOrCreateChunk(Arena& arena, int64_t cell, int& offset) {
+    ArenaChunk* chunk = findChunk(arena, cell, offset);
+    if (chunk == NULL) {
+        chunk = new ArenaChunk();    // Value-initialised: all cells empty, no claims
+        arena.chunks[chunkKey(arenaCellX(arena, cell) >> ARENA_CHUNK_SHIFT,
+                              arenaCellY(arena, cell) >> ARENA_CHUNK_SHIFT)].reset(chunk);
+    }
+    return chunk;
+}
+
+uint32_t arenaCellOwner(const Arena& arena, int64_t cell) {
+    int offset;
+    const ArenaChunk* chunk = findChunk(arena, cell, offset);
+    return chunk ? chunk->owner[offset] : ARENA_EMPTY;
+}
+
+const ArenaChunk* arenaChunkAt(const Arena& arena, int chunkX, int chunkY) {
+    auto it = arena.chunks.find(chunkKey(chunkX, chunkY));
+    return it == arena.chunks.end() ? NULL : it->second.get();
+}
+
+static void setCellOwner(Arena& arena, int64_t cell, uint32_t owner) {
+    int offset;
+    ArenaChunk* chunk = owner == ARENA_EMPTY ? findChunk(arena, cell, offset) : findOrCreateChunk(arena, cell, offset);
+    if (chunk == NULL) {
+        return;
+    }
+    uint32_t previous = chunk->owner[offset];
+    chunk->owner[offset] = owner;
+    if (previous == ARENA_EMPTY && owner != ARENA_EMPTY) {
+        ++chunk->occupied;
+    } else if (previous != ARENA_EMPTY && owner == ARENA_EMPTY && --chunk->occupied == 0) {
+        arena.emptiedChunks.push_back(chunkKey(arenaCellX(arena, cell) >> ARENA_CHUNK_SHIFT,
+                                               arenaCellY(arena, cell) >> ARENA_CHUNK_SHIFT));
+    }
+}
+
+static void releaseEmptyChunks(Arena& arena) {
+    for (size_t i = 0; i < arena.emptiedChunks.size(); ++i) {
+        auto it = arena.chunks.find(arena.emptiedChunks[i]);
+        if (it != arena.chunks.end() && it->second->occupied == 0) {
+            arena.chunks.erase(it);
+        }
+    }
+    arena.emptiedChunks.clear();
+}
+
+static int64_t randomCell(Arena& arena) {
+    int x = (int)(nextRandom(arena.rng) % (uint32_t)arena.cols);
+    int y = (int)(nextRandom(arena.rng) % (uint32_t)arena.rows);
+    return arenaCell(arena, x, y);
+}
+
+static int64_t stepCell(const Arena& arena, int64_t cell, char direction) {
+    int x = arenaCellX(arena, cell);
+    int y = arenaCellY(arena, cell);
+    switch (direction) {
+        case 'U': --y; break;
+        case 'D': ++y; break;
+        case 'L': --x; break;
+        case 'R': ++x; break;
+        default: break;
+    }
+    if (x < 0 || x >= arena.cols || y < 0 || y >= arena.rows) {
+        return -1;
+    }
+    return arenaCell(arena, x, y);
+}
+
+static char oppositeDirection(char direction) {
+    switch (direction) {
+        case 'U': return 'D';
+        case 'D': return 'U';
+        case 'L': return 'R';
+        case 'R': return 'L';
+        default: return 0;
+    }
+}
+
+static bool isFree(const Arena& arena, int64_t cell) {
+    if (cell < 0) {
+        return false;
+    }
+    uint32_t owner = arenaCellOwner(arena, cell);
+    return owner == ARENA_EMPTY || owner == ARENA_FOOD;
+}
+
+static void placeFood(Arena& arena) {
+    for (int attempt = 0; attempt < ARENA_SPAWN_ATTEMPTS; ++attempt) {
+        int64_t cell = randomCell(arena);
+        if (arenaCellOwner(arena, cell) == ARENA_EMPTY) {
+            setCellOwner(arena, cell, ARENA_FOOD);
+            arena.foods.push_back(cell);
+            return;
+        }
+    }
+}
+
+static bool spawnSnake(Arena& arena, int index, int length) {
+    static const char directions[4] = { 'U', 'D', 'L', 'R' };
+    ArenaSnake& snake = arena.snakes[index];
+
+    for (int attempt = 0; attempt < ARENA_SPAWN_ATTEMPTS; ++attempt) {
+        int64_t head = randomCell(arena);
+        char direction = directions[nextRandom(arena.rng) % 4];
+        char back = oppositeDirection(direction);
+
+        // The body trails behind the head, and the cell ahead must be open too
+        bool fits = arenaCellOwner(arena, head) == ARENA_EMPTY && isFree(arena, stepCell(arena, head, direction));
+        int64_t cell = head;
+        for (int i = 1; i < length && fits; ++i) {
+            cell = stepCell(arena, cell, back);
+            fits = cell >= 0 && arenaCellOwner(arena, cell) == ARENA_EMPTY;
+        }
+        if (!fits) {
+            continue;
+        }
+
+        snake.body.clear();
+        cell = head;
+        for (int i = 0; i < length; ++i) {
+            snake.body.push_back(cell);
+            setCellOwner(arena, cell, (uint32_t)index + 1);
+            cell = stepCell(arena, cell, back);
+        }
+        snake.direction = direction;
+        snake.alive = true;
+        snake.grow = false;
+        snake.points = 0;
+        snake.targetFood = -1;
+        return true;
+    }
+    return false;
+}
+
+static void killSnake(Arena& arena, int index) {
+    ArenaSnake& snake = arena.snakes[index];
+    for (size_t i = 0; i < snake.body.size(); ++i) {
+        setCellOwner(arena, snake.body[i], ARENA_EMPTY);
+    }
+    snake.body.clear();
+    snake.alive = false;
+    snake.respawnTicks = ARENA_RESPAWN_TICKS;
+}
+
+static int cellDistance(const Arena& arena, int64_t a, int64_t b) {
+    return abs(arenaCellX(arena, a) - arenaCellX(arena, b)) + abs(arenaCellY(arena, a) - arenaCellY(arena, b));
+}
+
+// Greedy AI: head for a nearby food, never into an occupied cell, and
+// prefer cells with more open neighbours so it rarely boxes itself in.
+// Only reads shared state, so decisions for different snakes are independent.
+static void chooseAIDirection(Arena& arena, int index) {
+    static const char directions[4] = { 'U', 'D', 'L', 'R' };
+    ArenaSnake& snake = arena.snakes[index];
+    int64_t head = snake.body.front();
+
+    if ((snake.targetFood < 0 || arenaCellOwner(arena, snake.targetFood) != ARENA_FOOD) && !arena.foods.empty()) {
+        uint32_t seed = mixBits(arena.tick * 2654435761U + (uint32_t)index);
+        int64_t best = -1;
+        int bestDistance = 0;
+        for (int i = 0; i < ARENA_FOOD_SAMPLES; ++i) {
+            seed = mixBits(seed + (uint32_t)i);
+            int64_t food = arena.foods[seed % arena.foods.size()];
+            int distance = cellDistance(arena, head, food);
+            if (best < 0 || distance < bestDistance) {
+                best = food;
+                bestDistance = distance;
+            }
+        }
+        snake.targetFood = best;
+    }
+
+    char chosen = snake.direction;
+    int bestScore = 0;
+    bool found = false;
+    for (int i = 0; i < 4; ++i) {
+        char direction = directions[i];
+        if (direction == oppositeDirection(snake.direction)) {
+            continue;
+        }
+        int64_t cell = stepCell(arena, head, direction);
+        if (!isFree(arena, cell)) {
+            continue;
+        }
+
+        int openNeighbours = 0;
+        for (int j = 0; j < 4; ++j) {
+            if (isFree(arena, stepCell(arena, cell, directions[j]))) {
+                ++openNeighbours;
+            }
+        }
+        int distance = snake.targetFood >= 0 ? cellDistance(arena, cell, snake.targetFood) : 0;
+        int score = distance * 2 + (4 - openNeighbours) * 3;
+        if (!found || score < bestScore) {
+            chosen = direction;
+            bestScore = score;
+            found = true;
+        }
+    }
+    snake.direction = chosen;
+}
+
+static void chooseAIDirections(int begin, int end, void* data) {
+    Arena& arena = *(Arena*)data;
+    for (int i = begin; i < end; ++i) {
+        if (arena.snakes[i].alive && arena.snakes[i].isAI) {
+            chooseAIDirection(arena, i);
+        }
+    }
+}
+
+void initArena(Arena& arena, int cols, int rows, int foodCount, uint32_t seed) {
+    arena.cols = cols;
+    arena.rows = rows;
+    arena.chunks.clear();
+    arena.emptiedChunks.clear();
+    arena.snakes.clear();
+    arena.foods.clear();
+    arena.foodTarget = foodCount;
+    arena.rng = seed ? seed : 1;
+    arena.tick = 0;
+    arena.nextHead.clear();
+    arena.claims.clear();
+    arena.jobs = NULL;
+
+    for (int i = 0; i < foodCount; ++i) {
+        placeFood(arena);
+    }
+}
+
+int addArenaSnake(Arena& arena, bool isAI, int length) {
+    ArenaSnake snake;
+    snake.direction = 'R';
+    snake.alive = false;
+    snake.isAI = isAI;
+    snake.grow = false;
+    snake.points = 0;
+    snake.respawnTicks = 0;
+    snake.targetFood = -1;
+    arena.snakes.push_back(snake);
+    arena.nextHead.push_back(-1);
+
+    int index = (int)arena.snakes.size() - 1;
+    if (!spawnSnake(arena, index, length)) {
+        cout << "Arena is too crowded to spawn snake " << index << endl;
+    }
+    return index;
+}
+
+void setArenaDirection(Arena& arena, int snakeIndex, char direction) {
+    ArenaSnake& snake = arena.snakes[snakeIndex];
+    if (direction != oppositeDirection(snake.direction)) {
+        snake.direction = direction;
+    }
+}
+
+ArenaEvents arenaTick(Arena& arena, int playerIndex) {
+    ArenaEvents events = { 0, 0, false, false };
+    int snakeCount = (int)arena.snakes.size();
+    ++arena.tick;
+
+    for (int i = 0; i < snakeCount; ++i) {
+        ArenaSnake& snake = arena.snakes[i];
+        if (!snake.alive && snake.isAI && --snake.respawnTicks <= 0) {
+            if (!spawnSnake(arena, i, ARENA_SNAKE_LENGTH)) {
+                snake.respawnTicks = ARENA_RESPAWN_TICKS;
+            }
+        }
+    }
+
+    parallelFor(arena.jobs, snakeCount, ARENA_AI_GRAIN, chooseAIDirections, &arena);
+
+    // Tails move first, so a head may enter the cell a tail leaves this tick
+    for (int i = 0; i < snakeCount; ++i) {
+        ArenaSnake& snake = arena.snakes[i];
+        if (!snake.alive) {
+            continue;
+        }
+        arena.nextHead[i] = stepCell(arena, snake.body.front(), snake.direction);
+        if (snake.grow) {
+            snake.grow = false;
+        } else {
+            setCellOwner(arena, snake.body.back(), ARENA_EMPTY);
+            snake.body.pop_back();
+        }
+    }
+
+    // Head-to-body and border: one lookup in the ownership grid
+    vector<int> dying;
+    for (int i = 0; i < snakeCount; ++i) {
+        if (!arena.snakes[i].alive) {
+            continue;
+        }
+        int64_t cell = arena.nextHead[i];
+        if (!isFree(arena, cell)) {
+            dying.push_back(i);
+            arena.nextHead[i] = -1;
+        }
+    }
+
+    // Head-to-head: the strictly longest snake entering a cell survives,
+    // equal lengths all die. The outcome does not depend on snake order.
+    arena.claims.clear();
+    for (int i = 0; i < snakeCount; ++i) {
+        int64_t cell = arena.nextHead[i];
+        if (!arena.snakes[i].alive || cell < 0) {
+            continue;
+        }
+        int length = (int)arena.snakes[i].body.size();
+        auto inserted = arena.claims.insert(make_pair(cell, ArenaClaim()));
+        ArenaClaim& claim = inserted.first->second;
+        if (inserted.second) {
+            claim.winner = i;
+            claim.length = length;
+        } else if (length > claim.length) {
+            if (claim.winner != ARENA_NO_SNAKE) {
+                dying.push_back(claim.winner);
+            }
+            claim.winner = i;
+            claim.length = length;
+        } else {
+            if (length == claim.length && claim.winner != ARENA_NO_SNAKE) {
+                dying.push_back(claim.winner);
+                claim.winner = ARENA_NO_SNAKE;
+            }
+            dying.push_back(i);
+        }
+    }
+
+    for (size_t i = 0; i < dying.size(); ++i) {
+        int index = dying[i];
+        if (!arena.snakes[index].alive) {
+            continue;
+        }
+        killSnake(arena, index);
+        ++events.deaths;
+        if (index == playerIndex) {
+            events.playerDied = true;
+        }
+    }
+
+    bool ateAny = false;
+    for (int i = 0; i < snakeCount; ++i) {
+        ArenaSnake& snake = arena.snakes[i];
+        if (!snake.alive) {
+            continue;
+        }
+        int64_t cell = arena.nextHead[i];
+        if (arenaCellOwner(arena, cell) == ARENA_FOOD) {
+            snake.grow = true;
+            snake.points += 10;
+            ++events.foodEaten;
+            ateAny = true;
+            if (i == playerIndex) {
+                events.playerAte = true;
+            }
+        }
+        setCellOwner(arena, cell, (uint32_t)i + 1);
+        snake.body.push_front(cell);
+    }
+
+    if (ateAny) {
+        vector<int64_t>& foods = arena.foods;
+        size_t kept = 0;
+        for (size_t i = 0; i < foods.size(); ++i) {
+            if (arenaCellOwner(arena, foods[i]) == ARENA_FOOD) {
+                foods[kept++] = foods[i];
+            }
+        }
+        foods.resize(kept);
+    }
+    for (int i = (int)arena.foods.size(); i < arena.foodTarget; ++i) {
+        placeFood(arena);
+    }
+    releaseEmptyChunks(arena);
+
+    return events;
+}
+
+void runArenaBenchmark(int snakeCount, int ticks, int side, JobSystem* jobs) {
+    if (side <= 0) {
+        // Roughly 160 cells per snake keeps the board busy without gridlock
+        side = 16;
+        while (side * side < snakeCount * 160) {
+            side *= 2;
+        }
+    }
+
+    Arena arena;
+    initArena(arena, side, side, snakeCount, 12345);
+    arena.jobs = jobs;
+    for (int i = 0; i < snakeCount; ++i) {
+        addArenaSnake(arena, true, ARENA_SNAKE_LENGTH);
+    }
+
+    long long deaths = 0;
+    long long eaten = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int t = 0; t < ticks; ++t) {
+        ArenaEvents events = arenaTick(arena, ARENA_NO_SNAKE);
+        deaths += events.deaths;
+        eaten += events.foodEaten;
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << "Arena benchmark: " << snakeCount << " AI snakes on " << side << "x" << side
+         << ", " << jobWorkerCount(jobs) + 1 << " thread(s), " << ticks << " ticks in " << seconds * 1000.0 << " ms" << endl;
+    cout << "  " << (seconds > 0 ? ticks / seconds : 0) << " ticks/s, "
+         << (ticks > 0 ? seconds * 1e6 / ticks : 0) << " us/tick, "
+         << eaten << " food eaten, " << deaths << " deaths" << endl;
+    cout << "  " << arena.chunks.size() << " chunks live, "
+         << arena.chunks.size() * sizeof(ArenaChunk) / 1024 << " KiB of board" << endl;
+}
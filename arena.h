@@ -0,0 +1,88 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "job_system.h"
+
+// Multi-snake arena: any number of snakes (local players and AI) share one
+// board. Every cell of the board records who owns it, so head-to-body and
+// head-to-head checks are a single lookup per snake per tick.
+//
+// The board is stored as sparse 64x64 chunks that are allocated when a
+// snake or food first lands in them and released once they empty again,
+// so memory follows the occupied area and worlds can be far larger than
+// the window. Cells are addressed as y * cols + x in 64 bits.
+
+#define ARENA_EMPTY 0u
+#define ARENA_FOOD 0xFFFFFFFFu
+#define ARENA_NO_SNAKE -1
+#define ARENA_CHUNK_SHIFT 6
+#define ARENA_CHUNK_SIZE (1 << ARENA_CHUNK_SHIFT)
+
+struct ArenaChunk{
+    uint32_t owner[ARENA_CHUNK_SIZE * ARENA_CHUNK_SIZE];   // ARENA_EMPTY, ARENA_FOOD or snake index + 1
+    int occupied;                                           // Non-empty cells, the chunk is freed at zero
+};
+
+// A cell one or more heads are moving into this tick
+struct ArenaClaim{
+    int winner;     // Snake index, or ARENA_NO_SNAKE once a tie killed everyone
+    int length;
+};
+
+struct ArenaSnake{
+    std::deque<int64_t> body;   // Cell indices, head first
+    char direction;             // 'U', 'D', 'L' or 'R'
+    bool alive;
+    bool isAI;
+    bool grow;                  // Food was eaten last tick, keep the tail once
+    int points;
+    int respawnTicks;           // AI snakes come back after this many ticks
+    int64_t targetFood;         // AI: cell of the food it is heading for, or -1
+};
+
+// What happened during one arenaTick, for sound effects and game over
+struct ArenaEvents{
+    int foodEaten;
+    int deaths;
+    bool playerAte;
+    bool playerDied;
+};
+
+struct Arena{
+    int cols, rows;
+    std::unordered_map<uint64_t, std::unique_ptr<ArenaChunk> > chunks;
+    std::vector<uint64_t> emptiedChunks;    // Candidates to free at the end of the tick
+    std::vector<ArenaSnake> snakes;
+    std::vector<int64_t> foods;             // Cells currently holding food
+    int foodTarget;                         // How many foods to keep on the board
+    uint32_t rng;
+    uint32_t tick;
+    std::vector<int64_t> nextHead;
+    std::unordered_map<int64_t, ArenaClaim> claims;    // Head-to-head scratch, cleared every tick
+    JobSystem* jobs;                                    // AI decisions run here when set
+};
+
+void initArena(Arena& arena, int cols, int rows, int foodCount, uint32_t seed);
+int addArenaSnake(Arena& arena, bool isAI, int length);
+void setArenaDirection(Arena& arena, int snakeIndex, char direction);
+ArenaEvents arenaTick(Arena& arena, int playerIndex);
+
+inline int arenaCellX(const Arena& arena, int64_t cell) { return (int)(cell % arena.cols); }
+inline int arenaCellY(const Arena& arena, int64_t cell) { return (int)(cell / arena.cols); }
+inline int64_t arenaCell(const Arena& arena, int x, int y) { return (int64_t)y * arena.cols + x; }
+
+uint32_t arenaCellOwner(const Arena& arena, int64_t cell);
+// The chunk covering chunk coordinates (chunkX, chunkY), or NULL if nothing is there
+const ArenaChunk* arenaChunkAt(const Arena& arena, int chunkX, int chunkY);
+
+// Runs a headless arena of AI snakes on a side x side world (0 picks a
+// size from the snake count) and prints the sustained tick rate
+void runArenaBenchmark(int snakeCount, int ticks, int side, JobSystem* jobs);
+
+#endif
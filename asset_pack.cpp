@@ -0,0 +1,57 @@
+#include "asset_pack.h"
+
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+bool openAssetPack(AssetPack& pack, const char* path) {
+    pack.entries = NULL;
+    pack.entryCount = 0;
+    if (!mapFile(pack.file, path)) {
+        return false;
+    }
+
+    const AssetPackHeader* header = (const AssetPackHeader*)pack.file.data;
+    bool valid = pack.file.size >= sizeof(AssetPackHeader) &&
+                 memcmp(header->magic, ASSET_PACK_MAGIC, 4) == 0 &&
+                 header->version == ASSET_PACK_VERSION &&
+                 header->entryCount <= (pack.file.size - sizeof(AssetPackHeader)) / sizeof(AssetPackEntry);
+    const AssetPackEntry* entries = (const AssetPackEntry*)(pack.file.data + sizeof(AssetPackHeader));
+    for (uint32_t i = 0; valid && i < header->entryCount; ++i) {
+        valid = entries[i].name[ASSET_PACK_NAME_LENGTH - 1] == '\0' &&
+                entries[i].offset <= pack.file.size &&
+                entries[i].size <= pack.file.size - entries[i].offset;
+    }
+    if (!valid) {
+        cout << "Ignoring invalid asset pack " << path << endl;
+        unmapFile(pack.file);
+        return false;
+    }
+
+    pack.entries = entries;
+    pack.entryCount = header->entryCount;
+    return true;
+}
+
+void closeAssetPack(AssetPack& pack) {
+    unmapFile(pack.file);
+    pack.entries = NULL;
+    pack.entryCount = 0;
+}
+
+SDL_RWops* openAsset(const AssetPack& pack, const string& name) {
+#ifdef EMBED_ASSETS
+    for (int i = 0; i < embeddedAssetCount; ++i) {
+        if (name == embeddedAssets[i].name) {
+            return SDL_RWFromConstMem(embeddedAssets[i].data, (int)embeddedAssets[i].size);
+        }
+    }
+#endif
+    for (uint32_t i = 0; i < pack.entryCount; ++i) {
+        if (name == pack.entries[i].name) {
+            return SDL_RWFromConstMem(pack.file.data + pack.entries[i].offset, (int)pack.entries[i].size);
+        }
+    }
+    return SDL_RWFromFile(name.c_str(), "rb");
+}
@@ -0,0 +1,63 @@
+#ifndef ASSET_PACK_H
+#define ASSET_PACK_H
+
+#include <SDL2/SDL_rwops.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "file_util.h"
+
+// All game assets in one file: a header, a table of contents and the raw
+// file bytes, each aligned to ASSET_PACK_ALIGNMENT. The pack is mapped
+// into memory once at startup and every asset is handed to SDL_image,
+// SDL_ttf and SDL_mixer straight from the mapping, without copies.
+//
+// Built by the pack_assets tool; all fields are little-endian.
+
+#define ASSET_PACK_MAGIC "SPAK"
+#define ASSET_PACK_VERSION 1
+#define ASSET_PACK_ALIGNMENT 64
+#define ASSET_PACK_NAME_LENGTH 48
+
+struct AssetPackHeader{
+    char magic[4];
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t reserved;
+};
+
+struct AssetPackEntry{
+    char name[ASSET_PACK_NAME_LENGTH];  // NUL-terminated file name
+    uint64_t offset;                    // From the start of the pack
+    uint64_t size;
+};
+
+struct AssetPack{
+    MappedFile file;
+    const AssetPackEntry* entries;
+    uint32_t entryCount;
+};
+
+// Returns false (and leaves the pack empty) if the file is missing or invalid
+bool openAssetPack(AssetPack& pack, const char* path);
+void closeAssetPack(AssetPack& pack);
+
+#ifdef EMBED_ASSETS
+// Assets compiled into the executable by embed_assets (embedded_assets.cpp)
+struct EmbeddedAsset{
+    const char* name;
+    const unsigned char* data;
+    size_t size;
+};
+
+extern const EmbeddedAsset embeddedAssets[];
+extern const int embeddedAssetCount;
+#endif
+
+// Finds name among the embedded assets (EMBED_ASSETS builds), then in the
+// pack, and wraps it in a read-only memory RWops. Falls back to the loose
+// file of that name when neither has it.
+SDL_RWops* openAsset(const AssetPack& pack, const std::string& name);
+
+#endif
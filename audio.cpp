@@ -0,0 +1,370 @@
+#include "audio.h"
+
+#include <SDL2/SDL.h>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+
+#define AUDIO_PROBE_MS 300
+#define AUDIO_LATE_FACTOR 2.0      // A callback this many periods after the last one is an underrun
+#define AUDIO_MAX_LATE_CALLBACKS 2
+#define AUDIO_PROBED_CHANNELS 64
+
+// Written by the audio thread during probing, read once the hook is removed
+struct CallbackProbe{
+    Uint64 lastCounter;
+    int callbacks;
+    int bytes;
+    double maxGapMs;
+    int lateCallbacks;
+    double periodMs;    // From the first callback's size, since the device may round the request up
+    int frameSize;
+    int frequency;
+};
+
+static int observedBufferFrames = 0;
+static bool latencyProbeEnabled = false;
+
+// One pending measurement per mixer channel; 0 means nothing is waiting
+static atomic<Uint64> playCounters[AUDIO_PROBED_CHANNELS];
+static atomic<long long> latencySamples(0);
+static atomic<long long> latencyTotalUs(0);
+static atomic<long long> latencyMaxUs(0);
+
+static double countsToMs(Uint64 counts) {
+    return counts * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+static void probePostMix(void* data, Uint8* stream, int len) {
+    (void)stream;
+    CallbackProbe* probe = (CallbackProbe*)data;
+    Uint64 now = SDL_GetPerformanceCounter();
+    if (probe->periodMs == 0 && probe->frameSize > 0) {
+        probe->periodMs = len / probe->frameSize * 1000.0 / probe->frequency;
+    }
+    if (probe->lastCounter != 0) {
+        double gapMs = countsToMs(now - probe->lastCounter);
+        if (gapMs > probe->maxGapMs) {
+            probe->maxGapMs = gapMs;
+        }
+        if (probe->periodMs > 0 && gapMs > probe->periodMs * AUDIO_LATE_FACTOR) {
+            ++probe->lateCallbacks;
+        }
+    }
+    probe->lastCounter = now;
+    probe->bytes = len;
+    ++probe->callbacks;
+}
+
+// Runs the open device for a moment and reports whether it kept up,
+// judged against the period of the buffer it actually got
+static bool deviceKeepsUp(int bufferFrames) {
+    CallbackProbe probe = { 0, 0, 0, 0.0, 0, 0.0, 0, AUDIO_FREQUENCY };
+    int channels;
+    Uint16 format;
+    if (Mix_QuerySpec(&probe.frequency, &format, &channels)) {
+        probe.frameSize = SDL_AUDIO_BITSIZE(format) / 8 * channels;
+    }
+    Mix_SetPostMix(probePostMix, &probe);
+    SDL_Delay(AUDIO_PROBE_MS);
+    Mix_SetPostMix(NULL, NULL);    // Takes the audio lock, so probe is stable after this
+
+    if (probe.frameSize > 0 && probe.bytes > 0) {
+        observedBufferFrames = probe.bytes / probe.frameSize;
+    }
+    int expected = probe.periodMs > 0 ? (int)(AUDIO_PROBE_MS / probe.periodMs) : 1;
+    bool keepsUp = probe.callbacks >= expected / 2 && probe.callbacks > 0 &&
+                   probe.lateCallbacks <= AUDIO_MAX_LATE_CALLBACKS;
+    cout << "Audio probe: " << bufferFrames << " frames, " << probe.callbacks << " callbacks, "
+         << probe.lateCallbacks << " late, max gap " << probe.maxGapMs << " ms"
+         << (keepsUp ? "" : " - underruns") << endl;
+    return keepsUp;
+}
+
+// The requested size that probing chose last time, or 0
+static int loadCachedBufferFrames(const char* settingsPath) {
+    ifstream file(settingsPath);
+    int frames = 0;
+    file >> frames;
+    return file && frames > 0 ? frames : 0;
+}
+
+static void saveCachedBufferFrames(const char* settingsPath, int frames) {
+    ofstream file(settingsPath, ios::trunc);
+    file << frames << endl;
+    if (!file) {
+        cout << "Unable to save the audio buffer size to " << settingsPath << endl;
+    }
+}
+
+// Leaves the device open with the first candidate that keeps up and returns
+// the size requested for it, or 0 with the device closed if none did
+static int openProbedDevice() {
+    static const int candidates[] = { 256, 512 };
+    for (size_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]); ++i) {
+        if (Mix_OpenAudio(AUDIO_FREQUENCY, MIX_DEFAULT_FORMAT, 2, candidates[i]) < 0) {
+            continue;
+        }
+        if (deviceKeepsUp(candidates[i])) {
+            return candidates[i];
+        }
+        Mix_CloseAudio();
+    }
+    return 0;
+}
+
+bool openAudioDevice(int bufferFrames, const char* settingsPath) {
+    if (bufferFrames == 0) {
+        bufferFrames = loadCachedBufferFrames(settingsPath);
+    }
+    if (bufferFrames <= 0) {
+        int chosen = openProbedDevice();
+        saveCachedBufferFrames(settingsPath, chosen > 0 ? chosen : AUDIO_FALLBACK_BUFFER);
+        if (chosen > 0) {
+            cout << "Audio buffer: " << observedBufferFrames << " frames ("
+                 << observedBufferFrames * 1000.0 / AUDIO_FREQUENCY << " ms)" << endl;
+            return true;
+        }
+        bufferFrames = AUDIO_FALLBACK_BUFFER;
+    }
+
+    if (Mix_OpenAudio(AUDIO_FREQUENCY, MIX_DEFAULT_FORMAT, 2, bufferFrames) < 0) {
+        return false;
+    }
+    observedBufferFrames = bufferFrames;
+    cout << "Audio buffer: " << bufferFrames << " frames ("
+         << bufferFrames * 1000.0 / AUDIO_FREQUENCY << " ms)" << endl;
+    return true;
+}
+
+int audioBufferFrames() {
+    return observedBufferFrames;
+}
+
+// Channel effect: the first time the mixer pulls samples for a sound that
+// playSound timestamped, the elapsed time is recorded
+static void latencyEffect(int channel, void* stream, int len, void* data) {
+    (void)stream;
+    (void)len;
+    (void)data;
+    if (channel < 0 || channel >= AUDIO_PROBED_CHANNELS) {
+        return;
+    }
+    Uint64 played = playCounters[channel].exchange(0);
+    if (played == 0) {
+        return;
+    }
+    long long elapsedUs = (long long)(countsToMs(SDL_GetPerformanceCounter() - played) * 1000.0);
+    latencySamples.fetch_add(1);
+    latencyTotalUs.fetch_add(elapsedUs);
+    long long previousMax = latencyMaxUs.load();
+    while (elapsedUs > previousMax && !latencyMaxUs.compare_exchange_weak(previousMax, elapsedUs)) {
+    }
+}
+
+void enableAudioLatencyProbe(bool enabled) {
+    latencyProbeEnabled = enabled;
+}
+
+void reportAudioLatency() {
+    if (!latencyProbeEnabled) {
+        return;
+    }
+    long long samples = latencySamples.load();
+    double bufferMs = observedBufferFrames * 1000.0 / AUDIO_FREQUENCY;
+    cout << "Audio latency: " << samples << " sounds measured";
+    if (samples > 0) {
+        cout << ", request to mixer callback avg " << latencyTotalUs.load() / 1000.0 / samples
+             << " ms, max " << latencyMaxUs.load() / 1000.0 << " ms";
+    }
+    cout << ", plus " << bufferMs << " ms device buffer" << endl;
+}
+
+int playSound(Mix_Chunk* chunk, int channel, Uint64 requested) {
+    if (!latencyProbeEnabled) {
+        return Mix_PlayChannel(channel, chunk, 0);
+    }
+
+    // The effect goes on after the play call, so if the mixer runs in between
+    // the first pass is missed and the figure is high by at most one buffer
+    if (requested == 0) {
+        requested = SDL_GetPerformanceCounter();
+    }
+    channel = Mix_PlayChannel(channel, chunk, 0);
+    if (channel >= 0 && channel < AUDIO_PROBED_CHANNELS) {
+        playCounters[channel].store(requested);
+        Mix_RegisterEffect(channel, latencyEffect, NULL, NULL);
+    }
+    return channel;
+}
+
+bool pushAudioEvent(AudioEventQueue& queue, SoundId sound, Uint64 posted) {
+    uint32_t tail = queue.tail.load(memory_order_relaxed);
+    if (tail - queue.head.load(memory_order_acquire) >= AUDIO_EVENT_QUEUE_SIZE) {
+        return false;
+    }
+    queue.events[tail & (AUDIO_EVENT_QUEUE_SIZE - 1)] = (uint8_t)sound;
+    queue.posted[tail & (AUDIO_EVENT_QUEUE_SIZE - 1)] = posted;
+    queue.tail.store(tail + 1, memory_order_release);
+    return true;
+}
+
+bool popAudioEvent(AudioEventQueue& queue, SoundId& sound, Uint64& posted) {
+    uint32_t head = queue.head.load(memory_order_relaxed);
+    if (head == queue.tail.load(memory_order_acquire)) {
+        return false;
+    }
+    sound = (SoundId)queue.events[head & (AUDIO_EVENT_QUEUE_SIZE - 1)];
+    posted = queue.posted[head & (AUDIO_EVENT_QUEUE_SIZE - 1)];
+    queue.head.store(head + 1, memory_order_release);
+    return true;
+}
+
+// Picks a channel for sound under the voice cap and priority rules, or -1
+static int chooseVoice(AudioDispatcher& dispatcher, int sound) {
+    const SoundDefinition& definition = dispatcher.sounds[sound];
+    int freeChannel = -1;
+    int oldestSame = -1;
+    int sameCount = 0;
+    int victim = -1;
+
+    for (int channel = 0; channel < AUDIO_VOICES; ++channel) {
+        if (!Mix_Playing(channel)) {
+            if (freeChannel < 0) {
+                freeChannel = channel;
+            }
+            continue;
+        }
+        int playing = dispatcher.channelSound[channel];
+        if (playing == sound) {
+            ++sameCount;
+            if (oldestSame < 0 || dispatcher.channelStarted[channel] < dispatcher.channelStarted[oldestSame]) {
+                oldestSame = channel;
+            }
+        }
+        int priority = playing >= 0 ? dispatcher.sounds[playing].priority : 0;
+        if (victim < 0) {
+            victim = channel;
+        } else {
+            int victimPriority = dispatcher.channelSound[victim] >= 0 ? dispatcher.sounds[dispatcher.channelSound[victim]].priority : 0;
+            if (priority < victimPriority ||
+                (priority == victimPriority && dispatcher.channelStarted[channel] < dispatcher.channelStarted[victim])) {
+                victim = channel;
+            }
+        }
+    }
+
+    if (sameCount >= definition.maxVoices) {
+        return oldestSame;
+    }
+    if (freeChannel >= 0) {
+        return freeChannel;
+    }
+    int victimPriority = dispatcher.channelSound[victim] >= 0 ? dispatcher.sounds[dispatcher.channelSound[victim]].priority : 0;
+    return victimPriority <= definition.priority ? victim : -1;
+}
+
+static int dispatcherMain(void* data) {
+    AudioDispatcher& dispatcher = *(AudioDispatcher*)data;
+    while (!dispatcher.stopping.load()) {
+        SDL_SemWaitTimeout(dispatcher.wake, 100);
+
+        // Requests that pile up between wakeups collapse into one voice per
+        // sound, started highest priority first. The latency probe times a
+        // collapsed sound from its earliest request.
+        bool requested[SOUND_COUNT] = { false };
+        Uint64 postedAt[SOUND_COUNT] = { 0 };
+        SoundId sound;
+        Uint64 posted;
+        while (popAudioEvent(dispatcher.queue, sound, posted)) {
+            if (sound >= 0 && sound < SOUND_COUNT && dispatcher.sounds[sound].chunk != NULL) {
+                if (!requested[sound] || posted < postedAt[sound]) {
+                    postedAt[sound] = posted;
+                }
+                requested[sound] = true;
+            }
+        }
+        while (true) {
+            int next = -1;
+            for (int i = 0; i < SOUND_COUNT; ++i) {
+                if (requested[i] && (next < 0 || dispatcher.sounds[i].priority > dispatcher.sounds[next].priority)) {
+                    next = i;
+                }
+            }
+            if (next < 0) {
+                break;
+            }
+            requested[next] = false;
+
+            int channel = chooseVoice(dispatcher, next);
+            if (channel < 0 || playSound(dispatcher.sounds[next].chunk, channel, postedAt[next]) < 0) {
+                dispatcher.dropped.fetch_add(1);
+                continue;
+            }
+            dispatcher.channelSound[channel] = next;
+            dispatcher.channelStarted[channel] = SDL_GetTicks();
+        }
+    }
+    return 0;
+}
+
+bool startAudioDispatcher(AudioDispatcher& dispatcher, const SoundDefinition sounds[SOUND_COUNT]) {
+    dispatcher.queue.head.store(0);
+    dispatcher.queue.tail.store(0);
+    for (int i = 0; i < SOUND_COUNT; ++i) {
+        dispatcher.sounds[i] = sounds[i];
+    }
+    for (int i = 0; i < AUDIO_VOICES; ++i) {
+        dispatcher.channelSound[i] = -1;
+        dispatcher.channelStarted[i] = 0;
+    }
+    dispatcher.stopping.store(false);
+    dispatcher.dropped.store(0);
+    dispatcher.thread = NULL;
+
+    Mix_AllocateChannels(AUDIO_VOICES);
+    dispatcher.wake = SDL_CreateSemaphore(0);
+    if (dispatcher.wake == NULL) {
+        cout << "Audio dispatcher creation failed: " << SDL_GetError() << endl;
+        return false;
+    }
+    dispatcher.thread = SDL_CreateThread(dispatcherMain, "audio dispatcher", &dispatcher);
+    if (dispatcher.thread == NULL) {
+        cout << "Audio dispatcher creation failed: " << SDL_GetError() << endl;
+        SDL_DestroySemaphore(dispatcher.wake);
+        dispatcher.wake = NULL;
+        return false;
+    }
+    return true;
+}
+
+void stopAudioDispatcher(AudioDispatcher& dispatcher) {
+    if (dispatcher.thread != NULL) {
+        dispatcher.stopping.store(true);
+        SDL_SemPost(dispatcher.wake);
+        SDL_WaitThread(dispatcher.thread, NULL);
+        dispatcher.thread = NULL;
+    }
+    if (dispatcher.wake != NULL) {
+        SDL_DestroySemaphore(dispatcher.wake);
+        dispatcher.wake = NULL;
+    }
+}
+
+void postSound(AudioDispatcher& dispatcher, SoundId sound) {
+    if (dispatcher.thread == NULL) {
+        // No dispatcher thread: play inline as before
+        if (dispatcher.sounds[sound].chunk != NULL) {
+            playSound(dispatcher.sounds[sound].chunk, -1);
+        }
+        return;
+    }
+    Uint64 posted = latencyProbeEnabled ? SDL_GetPerformanceCounter() : 0;
+    if (!pushAudioEvent(dispatcher.queue, sound, posted)) {
+        dispatcher.dropped.fetch_add(1);
+        return;
+    }
+    SDL_SemPost(dispatcher.wake);
+}
@@ -0,0 +1,90 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <SDL2/SDL_mixer.h>
+#include <SDL2/SDL_mutex.h>
+#include <SDL2/SDL_thread.h>
+#include <atomic>
+#include <cstdint>
+
+// Opening the mixer with a small buffer and measuring how late sounds are.
+//
+// The original 2048-frame buffer adds about 46 ms at 44.1 kHz before a
+// sound can be heard. openAudioDevice tries 256 and then 512 frames,
+// runs the device briefly with a post-mix hook watching for callbacks
+// that arrive late (underruns), and keeps the first size that runs
+// cleanly. If both underrun it falls back to 2048. Probing holds up
+// startup, so the choice is cached in a settings file and reused.
+
+#define AUDIO_FREQUENCY 44100
+#define AUDIO_FALLBACK_BUFFER 2048
+
+#define AUDIO_PROBE -1
+
+// bufferFrames above 0 is used as is. 0 uses the size cached in settingsPath,
+// probing and caching only when there is none; AUDIO_PROBE always probes.
+bool openAudioDevice(int bufferFrames, const char* settingsPath);
+// Frames per mixer callback as observed on the running device
+int audioBufferFrames();
+
+// Latency instrumentation: when enabled, every sound is timestamped where
+// the game asks for it (postSound, or playSound when called directly) and
+// a channel effect records when the mixer first pulls that sound's samples,
+// so time spent queued for the dispatcher counts too. The report includes
+// the device buffer on top of that.
+void enableAudioLatencyProbe(bool enabled);
+void reportAudioLatency();
+
+// Mix_PlayChannel(channel, chunk, 0), instrumented when the probe is on.
+// requested is the performance counter when the sound was asked for; 0 means now.
+int playSound(Mix_Chunk* chunk, int channel, Uint64 requested = 0);
+
+// Game code never calls the mixer directly. It posts sound events into a
+// bounded single-producer/single-consumer ring, and a dispatcher thread
+// drains the ring and starts voices, so the simulation never waits on the
+// audio lock. Each sound has a priority and a voice cap: extra requests
+// for a capped sound restart its oldest voice, a full mixer gives way only
+// to equal or higher priority, and anything else is dropped.
+
+#define AUDIO_EVENT_QUEUE_SIZE 256  // Power of two
+#define AUDIO_VOICES 8
+
+enum SoundId{
+    SOUND_EAT,
+    SOUND_GAME_OVER,
+    SOUND_COUNT
+};
+
+struct SoundDefinition{
+    Mix_Chunk* chunk;   // NULL sounds are ignored
+    int priority;       // Higher wins when the mixer is full
+    int maxVoices;
+};
+
+struct AudioEventQueue{
+    uint8_t events[AUDIO_EVENT_QUEUE_SIZE];
+    Uint64 posted[AUDIO_EVENT_QUEUE_SIZE];  // Performance counter at postSound, for the latency probe
+    std::atomic<uint32_t> head;     // Next slot to read, advanced by the consumer
+    std::atomic<uint32_t> tail;     // Next slot to write, advanced by the producer
+};
+
+struct AudioDispatcher{
+    AudioEventQueue queue;
+    SoundDefinition sounds[SOUND_COUNT];
+    int channelSound[AUDIO_VOICES];
+    Uint32 channelStarted[AUDIO_VOICES];
+    SDL_Thread* thread;
+    SDL_sem* wake;
+    std::atomic<bool> stopping;
+    std::atomic<uint32_t> dropped;  // Full queue or no voice free
+};
+
+bool pushAudioEvent(AudioEventQueue& queue, SoundId sound, Uint64 posted);
+bool popAudioEvent(AudioEventQueue& queue, SoundId& sound, Uint64& posted);
+
+bool startAudioDispatcher(AudioDispatcher& dispatcher, const SoundDefinition sounds[SOUND_COUNT]);
+void stopAudioDispatcher(AudioDispatcher& dispatcher);
+// Producer side; never blocks
+void postSound(AudioDispatcher& dispatcher, SoundId sound);
+
+#endif
@@ -0,0 +1,98 @@
+#include "audio_cache.h"
+
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+using namespace std;
+
+#define AUDIO_CACHE_MAGIC "SPCM"
+#define AUDIO_CACHE_VERSION 1
+
+// 32 bytes, so the samples after it stay aligned for any sample format
+struct AudioCacheHeader{
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceHash;
+    int32_t frequency;
+    uint16_t format;
+    uint16_t channels;
+    uint32_t length;    // Bytes of PCM after the header
+    uint32_t reserved;
+};
+
+// FNV-1a over the whole stream, then rewinds it for the decoder
+static bool hashSource(SDL_RWops* source, uint64_t& hash) {
+    unsigned char buffer[64 * 1024];
+    hash = 14695981039346656037ULL;
+    size_t count;
+    while ((count = SDL_RWread(source, buffer, 1, sizeof(buffer))) > 0) {
+        for (size_t i = 0; i < count; ++i) {
+            hash = (hash ^ buffer[i]) * 1099511628211ULL;
+        }
+    }
+    return SDL_RWseek(source, 0, RW_SEEK_SET) == 0;
+}
+
+Mix_Chunk* loadSoundCached(SDL_RWops* source, MappedFile& mapping, string& error) {
+    int frequency, channels;
+    Uint16 format;
+    uint64_t hash;
+    if (!Mix_QuerySpec(&frequency, &format, &channels) || !hashSource(source, hash)) {
+        Mix_Chunk* chunk = Mix_LoadWAV_RW(source, 1);
+        if (chunk == NULL) {
+            error = Mix_GetError();
+        }
+        return chunk;
+    }
+
+    ostringstream name;
+    name << AUDIO_CACHE_DIR << "/" << hex << hash << dec << "_" << frequency << "_" << format << "_" << channels << ".pcm";
+    string path = name.str();
+
+    if (mapFile(mapping, path.c_str())) {
+        const AudioCacheHeader* header = (const AudioCacheHeader*)mapping.data;
+        bool valid = mapping.size >= sizeof(AudioCacheHeader) &&
+                     memcmp(header->magic, AUDIO_CACHE_MAGIC, 4) == 0 &&
+                     header->version == AUDIO_CACHE_VERSION &&
+                     header->sourceHash == hash &&
+                     header->frequency == frequency &&
+                     header->format == format &&
+                     header->channels == channels &&
+                     header->length == mapping.size - sizeof(AudioCacheHeader);
+        if (valid) {
+            // QuickLoad chunks are never written to or freed by the mixer
+            Mix_Chunk* chunk = Mix_QuickLoad_RAW((Uint8*)mapping.data + sizeof(AudioCacheHeader), header->length);
+            if (chunk != NULL) {
+                SDL_RWclose(source);
+                return chunk;
+            }
+        }
+        unmapFile(mapping);
+    }
+
+    Mix_Chunk* chunk = Mix_LoadWAV_RW(source, 1);
+    if (chunk == NULL) {
+        error = Mix_GetError();
+        return NULL;
+    }
+
+    AudioCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, AUDIO_CACHE_MAGIC, 4);
+    header.version = AUDIO_CACHE_VERSION;
+    header.sourceHash = hash;
+    header.frequency = frequency;
+    header.format = format;
+    header.channels = (uint16_t)channels;
+    header.length = chunk->alen;
+
+    vector<unsigned char> blob(sizeof(header) + chunk->alen);
+    memcpy(blob.data(), &header, sizeof(header));
+    memcpy(blob.data() + sizeof(header), chunk->abuf, chunk->alen);
+    // A failed store only means the next startup decodes again
+    if (makeDirectory(AUDIO_CACHE_DIR)) {
+        writeFileAtomically(path, blob.data(), blob.size());
+    }
+    return chunk;
+}
@@ -0,0 +1,20 @@
+#ifndef AUDIO_CACHE_H
+#define AUDIO_CACHE_H
+
+#include <SDL2/SDL_mixer.h>
+#include <string>
+
+#include "file_util.h"
+
+// Sound effects decoded and converted to the opened device format are kept
+// in AUDIO_CACHE_DIR, keyed by a hash of the source bytes and the device
+// format. Later startups map the cached PCM and hand it to the mixer as is,
+// skipping MP3/WAV decoding and resampling.
+
+#define AUDIO_CACHE_DIR "audio_cache"
+
+// Loads a chunk from source (always closed). On a cache hit the chunk's
+// samples live in mapping, which must stay mapped until the chunk is freed.
+Mix_Chunk* loadSoundCached(SDL_RWops* source, MappedFile& mapping, std::string& error);
+
+#endif
@@ -0,0 +1,122 @@
+#include "background_writer.h"
+
+#include <cstdio>
+#include <iostream>
+
+#include "file_util.h"
+
+using namespace std;
+
+static bool performWrite(const WriteRequest& request) {
+    if (request.kind == WRITE_REPLACE) {
+        return writeFileAtomically(request.path, request.data.data(), request.data.size());
+    }
+    if (request.kind == WRITE_REMOVE) {
+        return remove(request.path.c_str()) == 0;
+    }
+    FILE* file = fopen(request.path.c_str(), "ab");
+    if (file == NULL) {
+        return false;
+    }
+    bool written = fwrite(request.data.data(), 1, request.data.size(), file) == request.data.size();
+    return fclose(file) == 0 && written;
+}
+
+static int writerMain(void* data) {
+    BackgroundWriter& writer = *(BackgroundWriter*)data;
+    SDL_LockMutex(writer.lock);
+    while (true) {
+        while (writer.pending.empty() && !writer.stopping) {
+            SDL_CondWait(writer.wake, writer.lock);
+        }
+        if (writer.pending.empty()) {
+            break;  // Stopping and drained
+        }
+        WriteRequest request = writer.pending.front();
+        writer.pending.pop_front();
+
+        SDL_UnlockMutex(writer.lock);
+        if (!performWrite(request)) {
+            cout << "Background write to " << request.path << " failed" << endl;
+        }
+        SDL_LockMutex(writer.lock);
+    }
+    SDL_UnlockMutex(writer.lock);
+    return 0;
+}
+
+bool startBackgroundWriter(BackgroundWriter& writer) {
+    writer.thread = NULL;
+    writer.stopping = false;
+    writer.lock = SDL_CreateMutex();
+    writer.wake = SDL_CreateCond();
+    if (writer.lock != NULL && writer.wake != NULL) {
+        writer.thread = SDL_CreateThread(writerMain, "background writer", &writer);
+    }
+    if (writer.thread == NULL) {
+        cout << "Background writer creation failed, writing inline: " << SDL_GetError() << endl;
+        return false;
+    }
+    return true;
+}
+
+void stopBackgroundWriter(BackgroundWriter& writer) {
+    if (writer.thread != NULL) {
+        SDL_LockMutex(writer.lock);
+        writer.stopping = true;
+        SDL_CondSignal(writer.wake);
+        SDL_UnlockMutex(writer.lock);
+        SDL_WaitThread(writer.thread, NULL);
+        writer.thread = NULL;
+    }
+    if (writer.wake != NULL) {
+        SDL_DestroyCond(writer.wake);
+        writer.wake = NULL;
+    }
+    if (writer.lock != NULL) {
+        SDL_DestroyMutex(writer.lock);
+        writer.lock = NULL;
+    }
+}
+
+static void queueWrite(BackgroundWriter& writer, const WriteRequest& request) {
+    if (writer.thread == NULL) {
+        performWrite(request);
+        return;
+    }
+    SDL_LockMutex(writer.lock);
+    // Only the latest request for the path may absorb a replace; merging
+    // past an append or removal would reorder the two
+    bool merged = false;
+    if (request.kind == WRITE_REPLACE) {
+        for (size_t i = writer.pending.size(); i-- > 0;) {
+            if (writer.pending[i].path == request.path) {
+                if (writer.pending[i].kind == WRITE_REPLACE) {
+                    writer.pending[i].data = request.data;
+                    merged = true;
+                }
+                break;
+            }
+        }
+    }
+    if (!merged) {
+        writer.pending.push_back(request);
+    }
+    SDL_CondSignal(writer.wake);
+    SDL_UnlockMutex(writer.lock);
+}
+
+void queueFileReplace(BackgroundWriter& writer, const string& path, const string& data) {
+    WriteRequest request = { path, data, WRITE_REPLACE };
+    queueWrite(writer, request);
+}
+
+void queueFileAppend(BackgroundWriter& writer, const string& path, const string& data) {
+    WriteRequest request = { path, data, WRITE_APPEND };
+    queueWrite(writer, request);
+}
+
+void queueFileRemove(BackgroundWriter& writer, const string& path) {
+    WriteRequest request = { path, string(), WRITE_REMOVE };
+    queueWrite(writer, request);
+}
@@ -0,0 +1,44 @@
+#ifndef BACKGROUND_WRITER_H
+#define BACKGROUND_WRITER_H
+
+#include <SDL2/SDL_mutex.h>
+#include <SDL2/SDL_thread.h>
+#include <deque>
+#include <string>
+
+// Does file writes on a dedicated thread so the frame loop never waits on
+// the disk. Queueing only copies the bytes under a short lock. Replacing
+// writes go through writeFileAtomically, and a replace that has not
+// started yet is overwritten by a newer one for the same path (unless an
+// append or removal of that path was queued in between).
+
+enum WriteKind{
+    WRITE_REPLACE,      // Atomically, through a temporary file
+    WRITE_APPEND,
+    WRITE_REMOVE
+};
+
+struct WriteRequest{
+    std::string path;
+    std::string data;
+    WriteKind kind;
+};
+
+struct BackgroundWriter{
+    SDL_Thread* thread;
+    SDL_mutex* lock;
+    SDL_cond* wake;
+    std::deque<WriteRequest> pending;
+    bool stopping;
+};
+
+bool startBackgroundWriter(BackgroundWriter& writer);
+// Finishes everything already queued, then joins the thread
+void stopBackgroundWriter(BackgroundWriter& writer);
+
+void queueFileReplace(BackgroundWriter& writer, const std::string& path, const std::string& data);
+void queueFileAppend(BackgroundWriter& writer, const std::string& path, const std::string& data);
+// Deletes the file after every write already queued for it
+void queueFileRemove(BackgroundWriter& writer, const std::string& path);
+
+#endif
@@ -0,0 +1,61 @@
+// Generates a C++ source file that embeds asset files as read-only arrays,
+// for builds with -DEMBED_ASSETS:
+//     embed_assets embedded_assets.cpp font11.ttf mainmenu.jpg gameplay.jpg eat.mp3 gOver.wav
+// Entries are stored under their file name without directories.
+
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        cout << "Usage: " << argv[0] << " <output.cpp> <file>..." << endl;
+        return 1;
+    }
+
+    ofstream output(argv[1], ios::trunc);
+    if (!output) {
+        cout << "Unable to write " << argv[1] << endl;
+        return 1;
+    }
+    output << "// Generated by embed_assets, do not edit\n\n";
+    output << "#include \"asset_pack.h\"\n\n";
+
+    vector<string> names;
+    for (int i = 2; i < argc; ++i) {
+        string path = argv[i];
+        ifstream input(path.c_str(), ios::binary);
+        if (!input) {
+            cout << "Unable to read " << path << endl;
+            return 1;
+        }
+        vector<unsigned char> bytes((istreambuf_iterator<char>(input)), istreambuf_iterator<char>());
+        names.push_back(path.substr(path.find_last_of("/\\") + 1));
+
+        // Aligned like pack entries so decoders see the same layout either way
+        output << "alignas(64) static const unsigned char asset" << i - 2 << "[" << bytes.size() + 1 << "] = {";
+        for (size_t j = 0; j < bytes.size(); ++j) {
+            output << (j % 24 == 0 ? "\n    " : "") << (unsigned)bytes[j] << ",";
+        }
+        output << "\n    0\n};\n\n";
+        cout << "  " << names.back() << " " << bytes.size() << " bytes" << endl;
+    }
+
+    output << "const EmbeddedAsset embeddedAssets[] = {\n";
+    for (size_t i = 0; i < names.size(); ++i) {
+        output << "    { \"" << names[i] << "\", asset" << i << ", sizeof(asset" << i << ") - 1 },\n";
+    }
+    output << "};\n\n";
+    output << "const int embeddedAssetCount = " << names.size() << ";\n";
+
+    if (!output) {
+        cout << "Failed writing " << argv[1] << endl;
+        return 1;
+    }
+    cout << "Embedded " << names.size() << " assets into " << argv[1] << endl;
+    return 0;
+}
@@ -0,0 +1,127 @@
+#include "file_util.h"
+
+#include <cstdio>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+bool mapFile(MappedFile& file, const char* path) {
+    file.data = NULL;
+    file.size = 0;
+#ifdef _WIN32
+    file.fileHandle = NULL;
+    file.mappingHandle = NULL;
+
+    HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(handle, &size) || size.QuadPart == 0) {
+        CloseHandle(handle);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL) {
+        CloseHandle(handle);
+        return false;
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == NULL) {
+        CloseHandle(mapping);
+        CloseHandle(handle);
+        return false;
+    }
+    file.data = (const unsigned char*)view;
+    file.size = (size_t)size.QuadPart;
+    file.fileHandle = handle;
+    file.mappingHandle = mapping;
+    return true;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    void* view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);  // The mapping keeps the file alive
+    if (view == MAP_FAILED) {
+        return false;
+    }
+    file.data = (const unsigned char*)view;
+    file.size = (size_t)info.st_size;
+    return true;
+#endif
+}
+
+void unmapFile(MappedFile& file) {
+    if (file.data == NULL) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(file.data);
+    CloseHandle((HANDLE)file.mappingHandle);
+    CloseHandle((HANDLE)file.fileHandle);
+    file.fileHandle = NULL;
+    file.mappingHandle = NULL;
+#else
+    munmap((void*)file.data, file.size);
+#endif
+    file.data = NULL;
+    file.size = 0;
+}
+
+bool writeFileAtomically(const string& path, const void* data, size_t size) {
+    // Write everything to a sibling temp file first; the rename is the commit point
+    string temporary = path + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    if (file == NULL) {
+        return false;
+    }
+    bool written = (size == 0 || fwrite(data, 1, size, file) == size) && fflush(file) == 0;
+#ifdef _WIN32
+    written = written && _commit(_fileno(file)) == 0;
+#else
+    written = written && fsync(fileno(file)) == 0;
+#endif
+    written = fclose(file) == 0 && written;
+    if (!written) {
+        remove(temporary.c_str());
+        return false;
+    }
+
+#ifdef _WIN32
+    bool renamed = MoveFileExA(temporary.c_str(), path.c_str(),
+                               MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    bool renamed = rename(temporary.c_str(), path.c_str()) == 0;
+#endif
+    if (!renamed) {
+        remove(temporary.c_str());
+    }
+    return renamed;
+}
+
+bool makeDirectory(const string& path) {
+#ifdef _WIN32
+    return _mkdir(path.c_str()) == 0 || GetFileAttributesA(path.c_str()) != INVALID_FILE_ATTRIBUTES;
+#else
+    struct stat info;
+    return mkdir(path.c_str(), 0755) == 0 || (stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode));
+#endif
+}
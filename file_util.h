@@ -0,0 +1,27 @@
+#ifndef FILE_UTIL_H
+#define FILE_UTIL_H
+
+#include <cstddef>
+#include <string>
+
+// A read-only file mapping
+struct MappedFile{
+    const unsigned char* data;
+    size_t size;
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#endif
+};
+
+bool mapFile(MappedFile& file, const char* path);
+void unmapFile(MappedFile& file);
+
+// Replaces path with data so a crash leaves either the old or the new
+// contents, never a mix: write and flush a temp file, then rename over
+bool writeFileAtomically(const std::string& path, const void* data, size_t size);
+
+// Creates the directory if it is not there yet
+bool makeDirectory(const std::string& path);
+
+#endif
@@ -0,0 +1,343 @@
+#include "game.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+using namespace std;
+
+static uint32_t nextRandom(Game& game) {
+    game.rng ^= game.rng << 13;
+    game.rng ^= game.rng >> 17;
+    game.rng ^= game.rng << 5;
+    return game.rng;
+}
+
+static void repositionFood(Game& game) {
+    game.food.x = (int)(nextRandom(game) % (uint32_t)game.cols);
+    game.food.y = (int)(nextRandom(game) % (uint32_t)game.rows);
+}
+
+void initGame(Game& game, int cols, int rows, int length, uint32_t seed) {
+    game.cols = max(cols, 1);
+    game.rows = max(rows, 1);
+    game.snake.clear();
+    int initialX = game.cols / 2;
+    int initialY = game.rows / 2;
+    length = min(max(length, 1), initialX + 1);     // Whole body on the board
+    for (int i = 0; i < length; ++i) {
+        game.snake.push_back({initialX - i, initialY});
+    }
+    game.direction = 'R';
+    game.grow = false;
+    game.over = false;
+    game.points = 0;
+    game.rng = seed != 0 ? seed : 0x9E3779B9u;
+    game.tick = 0;
+    repositionFood(game);
+}
+
+void setGameDirection(Game& game, char direction) {
+    if ((direction == 'U' && game.direction != 'D') ||
+        (direction == 'D' && game.direction != 'U') ||
+        (direction == 'L' && game.direction != 'R') ||
+        (direction == 'R' && game.direction != 'L')) {
+        game.direction = direction;
+    }
+}
+
+GameEvents stepGame(Game& game) {
+    GameEvents events = { false, false };
+    if (game.over) {
+        return events;
+    }
+
+    SnakeSegment head = game.snake.front();
+    switch (game.direction) {
+        case 'U': head.y -= 1; break;
+        case 'D': head.y += 1; break;
+        case 'L': head.x -= 1; break;
+        case 'R': head.x += 1; break;
+        default: break;
+    }
+    game.snake.push_front(head);
+    if (!game.grow) {
+        game.snake.pop_back();
+    }
+    game.grow = false;
+    game.tick++;
+
+    if (head.x == game.food.x && head.y == game.food.y) {
+        repositionFood(game);
+        game.grow = true;
+        game.points += 10;
+        events.ate = true;
+    }
+
+    bool hitBorder = head.x < 0 || head.x >= game.cols || head.y < 0 || head.y >= game.rows;
+    bool hitSelf = false;
+    for (size_t i = 1; i < game.snake.size() && !hitSelf; ++i) {
+        hitSelf = game.snake[i].x == head.x && game.snake[i].y == head.y;
+    }
+    if (hitBorder || hitSelf) {
+        game.over = true;
+        events.died = true;
+    }
+    return events;
+}
+
+// Snapshot layout after the version byte, least significant bit first:
+//   cols - 1, rows - 1          16 bits each
+//   direction, grow, over       2 + 1 + 1 bits
+//   delta coded body            1 bit
+//   points, rng, tick           32 bits each
+//   food x, y                   cell bits
+//   body length                 enough bits for cols * rows + 1
+//   head x + 1, y + 1           cell bits for one cell past either edge
+//   rest of the body            2-bit steps from the segment before, or
+//                               absolute cells when a step is not adjacent
+
+static const char stepDirections[4] = { 'U', 'D', 'L', 'R' };
+static const int stepX[4] = { 0, 0, -1, 1 };
+static const int stepY[4] = { -1, 1, 0, 0 };
+
+// Bits needed to store any value below count
+static int bitsFor(uint64_t count) {
+    int bits = 0;
+    while (bits < 64 && (uint64_t)1 << bits < count) {
+        ++bits;
+    }
+    return bits;
+}
+
+struct BitWriter{
+    uint8_t* out;
+    uint64_t buffer;
+    int buffered;
+};
+
+static void writeBits(BitWriter& writer, uint64_t value, int count) {
+    if (count > 32) {
+        writeBits(writer, value, 32);
+        value >>= 32;
+        count -= 32;
+    }
+    if (count == 0) {
+        return;
+    }
+    value &= ((uint64_t)1 << count) - 1;
+    writer.buffer |= value << writer.buffered;
+    writer.buffered += count;
+    if (writer.buffered >= 64) {
+        for (int b = 0; b < 8; ++b) {
+            *writer.out++ = (uint8_t)(writer.buffer >> (8 * b));
+        }
+        writer.buffered -= 64;
+        writer.buffer = writer.buffered > 0 ? value >> (count - writer.buffered) : 0;
+    }
+}
+
+static void flushBits(BitWriter& writer) {
+    for (int b = 0; b * 8 < writer.buffered; ++b) {
+        *writer.out++ = (uint8_t)(writer.buffer >> (8 * b));
+    }
+    writer.buffer = 0;
+    writer.buffered = 0;
+}
+
+struct BitReader{
+    const uint8_t* data;
+    size_t size;
+    size_t position;    // In bits
+};
+
+static bool readBits(BitReader& reader, int count, uint64_t& value) {
+    if (count > 32) {
+        uint64_t high;
+        if (!readBits(reader, 32, value) || !readBits(reader, count - 32, high)) {
+            return false;
+        }
+        value |= high << 32;
+        return true;
+    }
+    if (reader.position + count > reader.size * 8) {
+        return false;
+    }
+    // Up to 32 bits at any offset fit in the five bytes from the first one
+    size_t first = reader.position >> 3;
+    size_t last = min(reader.size, first + 5);
+    uint64_t word = 0;
+    for (size_t i = first; i < last; ++i) {
+        word |= (uint64_t)reader.data[i] << (8 * (i - first));
+    }
+    value = (word >> (reader.position & 7)) & (((uint64_t)1 << count) - 1);
+    reader.position += count;
+    return true;
+}
+
+// Index into stepX/stepY that leads from one segment to the next, or -1
+static int stepCode(const SnakeSegment& from, const SnakeSegment& to) {
+    int dx = to.x - from.x;
+    int dy = to.y - from.y;
+    if (dx == 0 && (dy == -1 || dy == 1)) {
+        return dy < 0 ? 0 : 1;
+    }
+    if (dy == 0 && (dx == -1 || dx == 1)) {
+        return dx < 0 ? 2 : 3;
+    }
+    return -1;
+}
+
+void snapshotGame(const Game& game, vector<uint8_t>& out) {
+    int cellX = bitsFor((uint64_t)game.cols);
+    int cellY = bitsFor((uint64_t)game.rows);
+    int edgeX = bitsFor((uint64_t)game.cols + 2);
+    int edgeY = bitsFor((uint64_t)game.rows + 2);
+    int lengthBits = bitsFor((uint64_t)game.cols * game.rows + 2);
+
+    bool delta = true;
+    for (auto it = game.snake.begin() + 1; it != game.snake.end() && delta; ++it) {
+        delta = stepCode(*(it - 1), *it) >= 0;
+    }
+    size_t bodyBits = (game.snake.size() - 1) * (delta ? 2 : edgeX + edgeY);
+    size_t totalBits = 32 + 5 + 96 + cellX + cellY + lengthBits + edgeX + edgeY + bodyBits;
+    out.resize(1 + (totalBits + 63) / 64 * 8);     // The writer stores whole words
+
+    out[0] = GAME_SNAPSHOT_VERSION;
+    BitWriter writer = { out.data() + 1, 0, 0 };
+    writeBits(writer, (uint64_t)(game.cols - 1), 16);
+    writeBits(writer, (uint64_t)(game.rows - 1), 16);
+    writeBits(writer, (uint64_t)(find(stepDirections, stepDirections + 4, game.direction) - stepDirections), 2);
+    writeBits(writer, game.grow ? 1 : 0, 1);
+    writeBits(writer, game.over ? 1 : 0, 1);
+    writeBits(writer, delta ? 1 : 0, 1);
+    writeBits(writer, (uint32_t)game.points, 32);
+    writeBits(writer, game.rng, 32);
+    writeBits(writer, game.tick, 32);
+    writeBits(writer, (uint64_t)game.food.x, cellX);
+    writeBits(writer, (uint64_t)game.food.y, cellY);
+    writeBits(writer, game.snake.size(), lengthBits);
+    writeBits(writer, (uint64_t)(game.snake.front().x + 1), edgeX);
+    writeBits(writer, (uint64_t)(game.snake.front().y + 1), edgeY);
+    SnakeSegment previous = game.snake.front();
+    for (auto it = game.snake.begin() + 1; it != game.snake.end(); ++it) {
+        if (delta) {
+            writeBits(writer, (uint64_t)stepCode(previous, *it), 2);
+        } else {
+            writeBits(writer, (uint64_t)(it->x + 1), edgeX);
+            writeBits(writer, (uint64_t)(it->y + 1), edgeY);
+        }
+        previous = *it;
+    }
+    flushBits(writer);
+    out.resize(1 + (totalBits + 7) / 8);
+}
+
+// Reads the next body segment after previous; false if the blob ends
+static bool readSegment(BitReader& reader, bool delta, int edgeX, int edgeY,
+                        const SnakeSegment& previous, SnakeSegment& segment) {
+    uint64_t a, b;
+    if (delta) {
+        if (!readBits(reader, 2, a)) {
+            return false;
+        }
+        segment.x = previous.x + stepX[a];
+        segment.y = previous.y + stepY[a];
+        return true;
+    }
+    if (!readBits(reader, edgeX, a) || !readBits(reader, edgeY, b)) {
+        return false;
+    }
+    segment.x = (int)a - 1;
+    segment.y = (int)b - 1;
+    return true;
+}
+
+bool restoreGame(Game& game, const uint8_t* data, size_t size) {
+    if (size < 1 || data[0] != GAME_SNAPSHOT_VERSION) {
+        return false;
+    }
+    BitReader reader = { data + 1, size - 1, 0 };
+    uint64_t cols, rows, direction, grow, over, delta, points, rng, tick, foodX, foodY, length, headX, headY;
+    if (!readBits(reader, 16, cols) || !readBits(reader, 16, rows)) {
+        return false;
+    }
+    cols += 1;
+    rows += 1;
+    int cellX = bitsFor(cols);
+    int cellY = bitsFor(rows);
+    int edgeX = bitsFor(cols + 2);
+    int edgeY = bitsFor(rows + 2);
+    if (!readBits(reader, 2, direction) || !readBits(reader, 1, grow) || !readBits(reader, 1, over) ||
+        !readBits(reader, 1, delta) || !readBits(reader, 32, points) || !readBits(reader, 32, rng) ||
+        !readBits(reader, 32, tick) || !readBits(reader, cellX, foodX) || !readBits(reader, cellY, foodY) ||
+        !readBits(reader, bitsFor(cols * rows + 2), length) ||
+        !readBits(reader, edgeX, headX) || !readBits(reader, edgeY, headY)) {
+        return false;
+    }
+    if (foodX >= cols || foodY >= rows || length < 1 || length > cols * rows + 1 || rng == 0 ||
+        headX > cols + 1 || headY > rows + 1) {
+        return false;
+    }
+    uint64_t segmentBits = delta ? 2 : edgeX + edgeY;
+    if ((length - 1) * segmentBits > reader.size * 8 - reader.position) {
+        return false;
+    }
+
+    // Decode the whole body before touching game; only the head may be off the board
+    static thread_local vector<SnakeSegment> body;
+    body.resize((size_t)length);
+    body[0].x = (int)headX - 1;
+    body[0].y = (int)headY - 1;
+    if (!over && (body[0].x < 0 || body[0].x >= (int)cols || body[0].y < 0 || body[0].y >= (int)rows)) {
+        return false;
+    }
+    for (size_t i = 1; i < body.size(); ++i) {
+        SnakeSegment& segment = body[i];
+        if (!readSegment(reader, delta != 0, edgeX, edgeY, body[i - 1], segment) ||
+            segment.x < 0 || segment.x >= (int)cols || segment.y < 0 || segment.y >= (int)rows) {
+            return false;
+        }
+    }
+
+    game.cols = (int)cols;
+    game.rows = (int)rows;
+    game.direction = stepDirections[direction];
+    game.grow = grow != 0;
+    game.over = over != 0;
+    game.points = (int)(uint32_t)points;
+    game.rng = (uint32_t)rng;
+    game.tick = (uint32_t)tick;
+    game.food.x = (int)foodX;
+    game.food.y = (int)foodY;
+    game.snake.assign(body.begin(), body.end());
+    return true;
+}
+
+void runSnapshotBenchmark(int cols, int rows, int length) {
+    Game game;
+    initGame(game, cols, rows, min(length, cols / 2 + 1), 12345);
+    vector<uint8_t> blob;
+    snapshotGame(game, blob);
+
+    const int rounds = 1000000;
+    Game copy = game;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i) {
+        game.tick = (uint32_t)i;    // Keep the loop from being folded away
+        snapshotGame(game, blob);
+    }
+    double snapshotSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    bool restored = true;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i) {
+        restored = restoreGame(copy, blob.data(), blob.size()) && restored;
+    }
+    double restoreSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << "Snapshot benchmark: " << game.cols << "x" << game.rows << ", length " << game.snake.size()
+         << ", " << blob.size() << " bytes" << endl;
+    cout << "  snapshot: " << snapshotSeconds * 1e9 / rounds << " ns" << endl;
+    cout << "  restore: " << restoreSeconds * 1e9 / rounds << " ns" << (restored ? "" : " (FAILED)") << endl;
+}
@@ -0,0 +1,60 @@
+#ifndef GAME_H
+#define GAME_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// The classic single-snake game, separate from rendering and input so it
+// can be stepped, saved, restored and copied on its own. Positions are in
+// cells; the window draws each cell SNAKE_SIZE pixels wide.
+//
+// Everything that decides the future is in Game, including the food RNG,
+// so a restored or copied game plays on exactly like the original.
+
+#define GAME_SNAPSHOT_VERSION 1
+
+struct SnakeSegment{
+    int x, y;
+};
+
+struct Food{
+    int x, y;
+};
+
+struct Game{
+    int cols, rows;
+    std::deque<SnakeSegment> snake;     // Head first
+    char direction;                     // 'U', 'D', 'L' or 'R'
+    bool grow;                          // Food was eaten last tick, keep the tail once
+    bool over;                          // The snake hit a wall or itself
+    Food food;
+    int points;
+    uint32_t rng;                       // xorshift32 state for food placement
+    uint32_t tick;
+};
+
+// What happened during one stepGame, for sound effects and game over
+struct GameEvents{
+    bool ate;
+    bool died;
+};
+
+void initGame(Game& game, int cols, int rows, int length, uint32_t seed);
+// Ignored when it would reverse the snake onto itself
+void setGameDirection(Game& game, char direction);
+GameEvents stepGame(Game& game);
+
+// Serialises the whole game into out (replacing its contents): a version
+// byte, then bit-packed fields, cells sized to the board and the body as
+// 2-bit steps from the head. Typically well under 64 bytes.
+void snapshotGame(const Game& game, std::vector<uint8_t>& out);
+// Returns false, leaving game untouched, if the blob is truncated, from
+// another version or describes an impossible game
+bool restoreGame(Game& game, const uint8_t* data, size_t size);
+
+// Times snapshot and restore of a default-size game
+void runSnapshotBenchmark(int cols, int rows, int length);
+
+#endif
@@ -0,0 +1,182 @@
+// Load generator for game_server:
+//     game_load [max sessions] [seconds per step] [port]
+// Opens sessions in doubling steps (100, 200, 400, ... up to max) and,
+// for each step, measures tick jitter: how far the gap between two ticks
+// of a session strays from GAME_SERVER_TICK_MS. The clients steer away
+// from the walls and otherwise turn at random, so the server does real
+// work. Everything runs on one epoll loop, so keep the client on another
+// core than the server when measuring.
+
+#include <cstdlib>
+#include <iostream>
+
+#ifdef __linux__
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <vector>
+
+#include "game_server.h"
+#include "net_util.h"
+
+using namespace std;
+
+struct LoadSession{
+    SocketHandle socket;
+    uint8_t partial[sizeof(ServerTick)];
+    size_t partialSize;
+    double lastTick;            // Microseconds; negative until the first tick of the step
+    uint32_t lastTickNumber;    // ServerTick.tick of that tick
+    bool lastOver;              // It ended a game, so the next one starts a new game at tick 1
+    uint32_t rng;
+};
+
+static double nowMicros() {
+    return chrono::duration<double, micro>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static char steer(LoadSession& session, const ServerTick& update) {
+    session.rng ^= session.rng << 13;
+    session.rng ^= session.rng >> 17;
+    session.rng ^= session.rng << 5;
+    if (update.headX <= 1) {
+        return update.headY < GAME_SERVER_ROWS / 2 ? 'D' : 'U';
+    }
+    if (update.headX >= GAME_SERVER_COLS - 2) {
+        return update.headY < GAME_SERVER_ROWS / 2 ? 'D' : 'U';
+    }
+    if (update.headY <= 1 || update.headY >= GAME_SERVER_ROWS - 2) {
+        return update.headX < GAME_SERVER_COLS / 2 ? 'R' : 'L';
+    }
+    static const char directions[4] = { 'U', 'D', 'L', 'R' };
+    return session.rng % 8 == 0 ? directions[(session.rng >> 8) % 4] : 0;
+}
+
+static double percentile(vector<float>& values, double fraction) {
+    if (values.empty()) {
+        return 0;
+    }
+    size_t index = min(values.size() - 1, (size_t)(fraction * values.size()));
+    nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+int main(int argc, char* argv[]) {
+    int maxSessions = argc > 1 ? atoi(argv[1]) : 6400;
+    int stepSeconds = argc > 2 ? max(1, atoi(argv[2])) : 5;
+    int port = argc > 3 ? atoi(argv[3]) : GAME_SERVER_PORT;
+
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    int epoll = epoll_create1(0);
+    vector<LoadSession> sessions;
+    vector<epoll_event> events(1024);
+    vector<float> jitter;
+    cout << "sessions   ticks/s   jitter p50    p99      max (ms)   dropped" << endl;
+    int target = min(100, maxSessions);
+    while (true) {
+        while ((int)sessions.size() < target) {
+            SocketHandle socket = connectLocal(port);
+            if (socket == NO_SOCKET || !setNonBlocking(socket)) {
+                cout << "Unable to open session " << sessions.size() + 1 << " on 127.0.0.1:" << port << endl;
+                return 1;
+            }
+            LoadSession session = LoadSession();
+            session.socket = socket;
+            session.rng = (uint32_t)sessions.size() * 2654435761u + 1;
+            epoll_event event = epoll_event();
+            event.events = EPOLLIN;
+            event.data.u32 = (uint32_t)sessions.size();
+            epoll_ctl(epoll, EPOLL_CTL_ADD, (int)socket, &event);
+            sessions.push_back(session);
+        }
+        for (LoadSession& session : sessions) {
+            session.lastTick = -1;
+        }
+
+        jitter.clear();
+        long long ticks = 0, dropped = 0;
+        double start = nowMicros();
+        double end = start + stepSeconds * 1e6;
+        while (nowMicros() < end) {
+            int ready = epoll_wait(epoll, events.data(), (int)events.size(), 100);
+            double now = nowMicros();
+            for (int i = 0; i < ready; ++i) {
+                LoadSession& session = sessions[events[i].data.u32];
+                uint8_t buffer[sizeof(ServerTick) * 16];
+                long received;
+                while ((received = receiveSocket(session.socket, buffer, sizeof(buffer))) > 0) {
+                    for (long b = 0; b < received; ++b) {
+                        session.partial[session.partialSize++] = buffer[b];
+                        if (session.partialSize < sizeof(ServerTick)) {
+                            continue;
+                        }
+                        session.partialSize = 0;
+                        ServerTick update;
+                        memcpy(&update, session.partial, sizeof(update));
+                        if (session.lastTick >= 0) {
+                            // The tick numbers say how many periods passed; a late tick is
+                            // jitter however late it is, and only a skipped number is a drop
+                            uint32_t expected = session.lastOver ? 1 : session.lastTickNumber + 1;
+                            if (update.tick < expected) {
+                                // A new game without the old one's game over: at least that
+                                // tick and the new game's earlier ones were dropped. How many
+                                // periods passed is unknown, so this gap is no jitter sample.
+                                dropped += max(1u, update.tick);
+                            } else {
+                                long skipped = (long)update.tick - (long)expected;
+                                dropped += skipped;
+                                double gap = (now - session.lastTick) / 1000.0;
+                                jitter.push_back((float)fabs(gap - (skipped + 1) * GAME_SERVER_TICK_MS));
+                            }
+                        }
+                        session.lastTick = now;
+                        session.lastTickNumber = update.tick;
+                        session.lastOver = update.over != 0;
+                        ticks++;
+                        char direction = steer(session, update);
+                        if (direction != 0) {
+                            sendSocket(session.socket, &direction, 1);
+                        }
+                    }
+                }
+                if (received < 0) {
+                    cout << "The server closed a session" << endl;
+                    return 1;
+                }
+            }
+        }
+
+        double seconds = (nowMicros() - start) / 1e6;
+        double worst = jitter.empty() ? 0 : *max_element(jitter.begin(), jitter.end());
+        double p99 = percentile(jitter, 0.99);
+        double p50 = percentile(jitter, 0.50);
+        printf("%8d %9.0f %12.3f %8.3f %8.3f %9lld\n", target, ticks / seconds, p50, p99, worst, dropped);
+        if (target >= maxSessions) {
+            break;
+        }
+        target = min(maxSessions, target * 2);
+    }
+    for (LoadSession& session : sessions) {
+        closeSocket(session.socket);
+    }
+    return 0;
+}
+
+#else
+
+int main() {
+    std::cout << "game_load uses epoll and only runs on Linux" << std::endl;
+    return 1;
+}
+
+#endif
@@ -0,0 +1,324 @@
+// Headless, authoritative host for many remote-controlled classic games:
+//     game_server [shards] [port]
+// Each connection on 127.0.0.1 is an independent session. Sessions are
+// dealt round-robin to shards, one thread each with its own epoll set, so
+// a session is only ever touched by one thread.
+//
+// Ticking uses a timer wheel per shard with one slot per millisecond of
+// the tick period, all driven by one shared clock. Every session has the
+// same period, so a session sits in a fixed slot for its whole life and
+// a tick costs nothing to reschedule. Slots are picked round-robin,
+// spreading the sessions evenly across the period.
+//
+// epoll is Linux only; elsewhere this builds to a stub that says so.
+
+#include <cstdlib>
+#include <iostream>
+
+#ifdef __linux__
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <mutex>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <thread>
+#include <vector>
+
+#include "game.h"
+#include "game_server.h"
+#include "net_util.h"
+
+using namespace std;
+
+#define SHARD_EVENTS 256
+
+struct Session{
+    SocketHandle socket;        // NO_SOCKET once closed; the slot is then free
+    Game game;
+    uint32_t seed;
+    uint32_t wheelSlot;         // Where the session sits in its shard's wheel
+    uint32_t wheelIndex;
+    uint8_t unsent[sizeof(ServerTick)];     // Tail of a tick the socket only took part of
+    uint32_t unsentSize;
+};
+
+struct Shard{
+    int epoll;
+    thread worker;
+    mutex lock;
+    vector<SocketHandle> incoming;  // Accepted, waiting for the shard to adopt them; guarded by lock
+    vector<Session> sessions;
+    vector<uint32_t> freeSessions;
+    vector<vector<uint32_t> > wheel;
+    uint32_t nextWheelSlot;         // Where the next new session goes
+    long long nextTick;             // Millisecond of the first slot not yet ticked
+    atomic<int> sessionCount;
+    atomic<long long> ticks;
+};
+
+static atomic<bool> stopping(false);
+static chrono::steady_clock::time_point startTime;
+
+static long long nowMs() {
+    return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - startTime).count();
+}
+
+// Takes the session out of the wheel at once, so its index can be reused
+// without the new session being ticked from two slots
+static void closeSession(Shard& shard, uint32_t index) {
+    Session& session = shard.sessions[index];
+    vector<uint32_t>& slot = shard.wheel[session.wheelSlot];
+    uint32_t moved = slot.back();
+    slot[session.wheelIndex] = moved;
+    shard.sessions[moved].wheelIndex = session.wheelIndex;
+    slot.pop_back();
+
+    epoll_ctl(shard.epoll, EPOLL_CTL_DEL, (int)session.socket, NULL);
+    closeSocket(session.socket);
+    session.socket = NO_SOCKET;
+    shard.freeSessions.push_back(index);
+    shard.sessionCount--;
+}
+
+static void adoptSessions(Shard& shard) {
+    vector<SocketHandle> sockets;
+    {
+        lock_guard<mutex> guard(shard.lock);
+        sockets.swap(shard.incoming);
+    }
+    for (SocketHandle socket : sockets) {
+        uint32_t index;
+        if (!shard.freeSessions.empty()) {
+            index = shard.freeSessions.back();
+            shard.freeSessions.pop_back();
+        } else {
+            index = (uint32_t)shard.sessions.size();
+            shard.sessions.push_back(Session());
+        }
+        Session& session = shard.sessions[index];
+        session.socket = socket;
+        session.seed = index * 2654435761u + (uint32_t)socket;
+        session.unsentSize = 0;
+        initGame(session.game, GAME_SERVER_COLS, GAME_SERVER_ROWS, 3, session.seed);
+
+        epoll_event event = epoll_event();
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.u32 = index;
+        if (epoll_ctl(shard.epoll, EPOLL_CTL_ADD, (int)socket, &event) != 0) {
+            closeSocket(socket);
+            session.socket = NO_SOCKET;
+            shard.freeSessions.push_back(index);
+            continue;
+        }
+        session.wheelSlot = shard.nextWheelSlot;
+        session.wheelIndex = (uint32_t)shard.wheel[session.wheelSlot].size();
+        shard.wheel[session.wheelSlot].push_back(index);
+        shard.nextWheelSlot = (shard.nextWheelSlot + 1) % GAME_SERVER_TICK_MS;
+        shard.sessionCount++;
+    }
+}
+
+// Applies the last direction the client sent; false once it has gone
+static bool readDirections(Session& session) {
+    char buffer[64];
+    long received;
+    while ((received = receiveSocket(session.socket, buffer, sizeof(buffer))) > 0) {
+        for (long i = 0; i < received; ++i) {
+            char direction = buffer[i];
+            if (direction == 'U' || direction == 'D' || direction == 'L' || direction == 'R') {
+                setGameDirection(session.game, direction);
+            }
+        }
+    }
+    return received == 0;
+}
+
+static void watchWritable(Shard& shard, uint32_t index, bool writable) {
+    epoll_event event = epoll_event();
+    event.events = EPOLLIN | EPOLLRDHUP | (writable ? (uint32_t)EPOLLOUT : 0u);
+    event.data.u32 = index;
+    epoll_ctl(shard.epoll, EPOLL_CTL_MOD, (int)shard.sessions[index].socket, &event);
+}
+
+// Sends what is left of a partly written tick; false once the client has gone
+static bool flushUnsent(Shard& shard, uint32_t index) {
+    Session& session = shard.sessions[index];
+    if (session.unsentSize == 0) {
+        return true;
+    }
+    long sent = sendSocket(session.socket, session.unsent, session.unsentSize);
+    if (sent < 0) {
+        return false;
+    }
+    session.unsentSize -= (uint32_t)sent;
+    memmove(session.unsent, session.unsent + sent, session.unsentSize);
+    if (session.unsentSize == 0) {
+        watchWritable(shard, index, false);
+    }
+    return true;
+}
+
+// Ticks only ever go out whole, so the client's framing holds. While the
+// tail of an earlier tick is still waiting, new ticks are dropped; the next
+// one sent carries the full head state.
+static bool tickSession(Shard& shard, uint32_t index) {
+    Session& session = shard.sessions[index];
+    stepGame(session.game);
+    ServerTick update;
+    update.tick = session.game.tick;
+    update.headX = (int16_t)session.game.snake.front().x;
+    update.headY = (int16_t)session.game.snake.front().y;
+    update.length = (uint16_t)session.game.snake.size();
+    update.over = session.game.over;
+    update.reserved = 0;
+    if (session.game.over) {
+        session.seed = session.seed * 1664525u + 1013904223u;
+        initGame(session.game, GAME_SERVER_COLS, GAME_SERVER_ROWS, 3, session.seed);
+    }
+    if (!flushUnsent(shard, index)) {
+        return false;
+    }
+    if (session.unsentSize > 0) {
+        return true;
+    }
+    long sent = sendSocket(session.socket, &update, sizeof(update));
+    if (sent < 0) {
+        return false;
+    }
+    if (sent < (long)sizeof(update)) {
+        session.unsentSize = (uint32_t)(sizeof(update) - sent);
+        memcpy(session.unsent, (const uint8_t*)&update + sent, session.unsentSize);
+        watchWritable(shard, index, true);
+    }
+    return true;
+}
+
+static void runShard(Shard& shard) {
+    epoll_event events[SHARD_EVENTS];
+    while (!stopping) {
+        int timeout = (int)max(0LL, shard.nextTick - nowMs());
+        int ready = epoll_wait(shard.epoll, events, SHARD_EVENTS, min(timeout, 100));
+        for (int i = 0; i < ready; ++i) {
+            uint32_t index = events[i].data.u32;
+            if (shard.sessions[index].socket == NO_SOCKET) {
+                continue;
+            }
+            bool open = (events[i].events & (EPOLLHUP | EPOLLERR)) == 0 && readDirections(shard.sessions[index]);
+            if (open && (events[i].events & EPOLLOUT) != 0) {
+                open = flushUnsent(shard, index);
+            }
+            if (!open) {
+                closeSession(shard, index);
+            }
+        }
+        adoptSessions(shard);
+
+        // Every slot whose millisecond has come, including any a slow pass fell behind on
+        long long now = nowMs();
+        for (; shard.nextTick <= now; ++shard.nextTick) {
+            vector<uint32_t>& slot = shard.wheel[shard.nextTick % GAME_SERVER_TICK_MS];
+            for (size_t i = 0; i < slot.size();) {
+                uint32_t index = slot[i];
+                if (!tickSession(shard, index)) {
+                    closeSession(shard, index);     // Moves the last session of the slot into i
+                    continue;
+                }
+                shard.ticks++;
+                ++i;
+            }
+        }
+    }
+}
+
+static void requestStop(int) {
+    stopping = true;
+}
+
+int main(int argc, char* argv[]) {
+    int shardCount = argc > 1 ? max(1, atoi(argv[1])) : max(1, (int)thread::hardware_concurrency());
+    int port = argc > 2 ? atoi(argv[2]) : GAME_SERVER_PORT;
+
+    // Thousands of sessions need thousands of descriptors
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    signal(SIGINT, requestStop);
+    signal(SIGTERM, requestStop);
+
+    SocketHandle listener = listenLocal(port, 4096);
+    if (listener == NO_SOCKET) {
+        return 1;
+    }
+    int acceptEpoll = epoll_create1(0);
+    epoll_event listenEvent = epoll_event();
+    listenEvent.events = EPOLLIN;
+    epoll_ctl(acceptEpoll, EPOLL_CTL_ADD, (int)listener, &listenEvent);
+
+    startTime = chrono::steady_clock::now();
+    vector<Shard> shards(shardCount);
+    for (Shard& shard : shards) {
+        shard.epoll = epoll_create1(0);
+        shard.wheel.resize(GAME_SERVER_TICK_MS);
+        shard.nextWheelSlot = 0;
+        shard.nextTick = 0;
+        shard.sessionCount = 0;
+        shard.ticks = 0;
+        shard.worker = thread(runShard, ref(shard));
+    }
+    cout << "Serving on 127.0.0.1:" << port << " with " << shardCount << " shards, a tick every "
+         << GAME_SERVER_TICK_MS << " ms" << endl;
+
+    size_t nextShard = 0;
+    long long lastReport = nowMs();
+    long long lastTicks = 0;
+    while (!stopping) {
+        epoll_event event;
+        if (epoll_wait(acceptEpoll, &event, 1, 1000) > 0) {
+            SocketHandle socket;
+            while ((socket = acceptSocket(listener)) != NO_SOCKET) {
+                Shard& shard = shards[nextShard++ % shards.size()];
+                lock_guard<mutex> guard(shard.lock);
+                shard.incoming.push_back(socket);
+            }
+        }
+        if (nowMs() - lastReport >= 5000) {
+            int sessions = 0;
+            long long ticks = 0;
+            for (Shard& shard : shards) {
+                sessions += shard.sessionCount;
+                ticks += shard.ticks;
+            }
+            long long now = nowMs();
+            cout << sessions << " sessions, " << (ticks - lastTicks) * 1000 / (now - lastReport) << " ticks/s" << endl;
+            lastReport = now;
+            lastTicks = ticks;
+        }
+    }
+
+    for (Shard& shard : shards) {
+        shard.worker.join();
+        for (Session& session : shard.sessions) {
+            closeSocket(session.socket);
+        }
+        for (SocketHandle socket : shard.incoming) {
+            closeSocket(socket);
+        }
+    }
+    closeSocket(listener);
+    cout << "Server stopped" << endl;
+    return 0;
+}
+
+#else
+
+int main() {
+    std::cout << "game_server uses epoll and only runs on Linux" << std::endl;
+    return 1;
+}
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef GAME_SERVER_H
+#define GAME_SERVER_H
+
+#include <cstdint>
+
+// Protocol between game_server and game_load, over TCP on 127.0.0.1.
+// Every connection is one session of the classic game. The client sends a
+// direction byte ('U', 'D', 'L' or 'R') whenever it wants to turn; the
+// server answers every tick with a ServerTick. A session that dies starts
+// a new game straight away, so the load stays constant.
+
+#define GAME_SERVER_PORT 7532
+#define GAME_SERVER_TICK_MS 50      // Each session ticks 20 times a second
+#define GAME_SERVER_COLS 54
+#define GAME_SERVER_ROWS 34
+
+struct ServerTick{
+    uint32_t tick;
+    int16_t headX, headY;
+    uint16_t length;
+    uint8_t over;               // The snake died this tick; the next tick is a new game
+    uint8_t reserved;
+};
+
+#endif
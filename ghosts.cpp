@@ -0,0 +1,202 @@
+#include "ghosts.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+using namespace std;
+
+// Hues a golden-ratio step apart, so neighbouring ghosts never look alike
+static SDL_Color ghostColor(int index) {
+    float hue = fmod(index * 0.618034f, 1.0f) * 6.0f;
+    float fraction = hue - floor(hue);
+    Uint8 high = 255, low = 60;
+    Uint8 rising = (Uint8)(low + (high - low) * fraction);
+    Uint8 falling = (Uint8)(high - (high - low) * fraction);
+    switch ((int)hue) {
+        case 0: return { high, rising, low, 255 };
+        case 1: return { falling, high, low, 255 };
+        case 2: return { low, high, rising, 255 };
+        case 3: return { low, falling, high, 255 };
+        case 4: return { rising, low, high, 255 };
+        default: return { high, low, falling, 255 };
+    }
+}
+
+void initGhosts(GhostSet& set, JobSystem* jobs, int cellSize, Uint8 alpha) {
+    set.ghosts.clear();
+    set.ghosts.reserve(GHOST_LIMIT);
+    set.jobs = jobs;
+    set.cellSize = cellSize;
+    set.alpha = alpha;
+    set.vertices.clear();
+    set.quadCount = 0;
+    set.playingCount = 0;
+}
+
+bool addGhost(GhostSet& set, const uint8_t* data, size_t size) {
+    if (set.ghosts.size() >= GHOST_LIMIT) {
+        return false;
+    }
+    set.ghosts.push_back(Ghost());
+    Ghost& ghost = set.ghosts.back();
+    ghost.data.assign(data, data + size);
+    if (!openReplayData(ghost.replay, ghost.data.data(), ghost.data.size()) ||
+        !seekReplay(ghost.replay, ghost.replay.header->startTick, ghost.game, ghost.cursor)) {
+        set.ghosts.pop_back();
+        return false;
+    }
+    ghost.playing = true;
+    ghost.color = ghostColor((int)set.ghosts.size() - 1);
+    ghost.firstVertex = 0;
+    set.playingCount++;
+    return true;
+}
+
+bool addGhostFile(GhostSet& set, const char* path) {
+    ifstream file(path, ios::binary);
+    vector<uint8_t> data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    return !data.empty() && addGhost(set, data.data(), data.size());
+}
+
+int addGhostArchive(GhostSet& set, const char* path, int limit) {
+    ifstream file(path, ios::binary);
+    ReplayArchiveHeader header;
+    if (!file.read((char*)&header, sizeof(header)) || memcmp(header.magic, REPLAY_ARCHIVE_MAGIC, 4) != 0 ||
+        header.version != REPLAY_ARCHIVE_VERSION) {
+        cout << "Not a replay archive: " << path << endl;
+        return 0;
+    }
+    // The length fields are only trusted as far as the file actually goes,
+    // so a corrupt one cannot ask for gigabytes
+    file.seekg(0, ios::end);
+    uint64_t fileSize = (uint64_t)file.tellg();
+    file.seekg(sizeof(header));
+    int added = 0;
+    uint32_t size;
+    vector<uint8_t> data;
+    while (added < limit && file.read((char*)&size, 4)) {
+        if (size > fileSize - (uint64_t)file.tellg()) {
+            cout << "Archive " << path << " is truncated" << endl;
+            break;
+        }
+        data.resize(size);
+        if (!file.read((char*)data.data(), size)) {
+            cout << "Archive " << path << " is truncated" << endl;
+            break;
+        }
+        if (addGhost(set, data.data(), data.size())) {
+            added++;
+        } else if (set.ghosts.size() >= GHOST_LIMIT) {
+            break;
+        }
+    }
+    return added;
+}
+
+void restartGhosts(GhostSet& set) {
+    set.playingCount = 0;
+    for (Ghost& ghost : set.ghosts) {
+        ghost.playing = seekReplay(ghost.replay, ghost.replay.header->startTick, ghost.game, ghost.cursor);
+        set.playingCount += ghost.playing;
+    }
+    set.quadCount = 0;
+}
+
+static void stepGhostRange(int begin, int end, void* data) {
+    GhostSet& set = *(GhostSet*)data;
+    for (int i = begin; i < end; ++i) {
+        Ghost& ghost = set.ghosts[i];
+        if (ghost.playing) {
+            ghost.playing = stepReplay(ghost.replay, ghost.cursor, ghost.game) && !ghost.game.over;
+        }
+    }
+}
+
+static void writeQuad(SDL_Vertex* vertex, const SnakeSegment& segment, int cellSize, SDL_Color color) {
+    float left = (float)(segment.x * cellSize), top = (float)(segment.y * cellSize);
+    float right = left + cellSize, bottom = top + cellSize;
+    vertex[0] = { { left, top }, color, { 0, 0 } };
+    vertex[1] = { { right, top }, color, { 0, 0 } };
+    vertex[2] = { { right, bottom }, color, { 0, 0 } };
+    vertex[3] = { { left, bottom }, color, { 0, 0 } };
+}
+
+static void buildGhostRange(int begin, int end, void* data) {
+    GhostSet& set = *(GhostSet*)data;
+    for (int i = begin; i < end; ++i) {
+        const Ghost& ghost = set.ghosts[i];
+        if (!ghost.playing) {
+            continue;
+        }
+        SDL_Vertex* vertex = set.vertices.data() + ghost.firstVertex;
+        SDL_Color body = ghost.color;
+        body.a = set.alpha;
+        // The head is brighter and more opaque so each ghost's direction reads at a glance
+        SDL_Color head = { (Uint8)((body.r + 255) / 2), (Uint8)((body.g + 255) / 2), (Uint8)((body.b + 255) / 2),
+                           (Uint8)min(255, set.alpha * 2) };
+        for (size_t s = 0; s < ghost.game.snake.size(); ++s, vertex += 4) {
+            writeQuad(vertex, ghost.game.snake[s], set.cellSize, s == 0 ? head : body);
+        }
+    }
+}
+
+bool stepGhosts(GhostSet& set) {
+    int count = (int)set.ghosts.size();
+    parallelFor(set.jobs, count, 16, stepGhostRange, &set);
+
+    // Each ghost gets its own stretch of the buffer, so the quads can be written in parallel too
+    uint32_t quads = 0;
+    set.playingCount = 0;
+    for (Ghost& ghost : set.ghosts) {
+        ghost.firstVertex = quads * 4;
+        if (ghost.playing) {
+            quads += (uint32_t)ghost.game.snake.size();
+            set.playingCount++;
+        }
+    }
+    set.vertices.resize(quads * 4);
+    for (uint32_t q = (uint32_t)set.indices.size() / 6; q < quads; ++q) {
+        int first = (int)q * 4;
+        int corners[6] = { first, first + 1, first + 2, first, first + 2, first + 3 };
+        set.indices.insert(set.indices.end(), corners, corners + 6);
+    }
+    set.quadCount = (int)quads;
+    parallelFor(set.jobs, count, 16, buildGhostRange, &set);
+    return set.playingCount > 0;
+}
+
+void runGhostBenchmark(const char* archivePath, int count, JobSystem* jobs) {
+    GhostSet set;
+    initGhosts(set, jobs, 20, 96);
+    int added = addGhostArchive(set, archivePath, count);
+    if (added == 0) {
+        return;
+    }
+    cout << "Ghost benchmark: " << added << " replays, " << jobWorkerCount(jobs) + 1 << " threads" << endl;
+
+    int frames = 0;
+    long long quads = 0;
+    double total = 0, worst = 0;
+    while (frames < 5000) {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        bool anyPlaying = stepGhosts(set);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (!anyPlaying) {
+            break;
+        }
+        total += seconds;
+        worst = max(worst, seconds);
+        quads += set.quadCount;
+        frames++;
+    }
+    if (frames == 0) {
+        return;
+    }
+    cout << "  " << frames << " ticks, " << quads / frames << " quads per tick" << endl;
+    cout << "  step and build: " << total * 1e3 / frames << " ms average, " << worst * 1e3 << " ms worst" << endl;
+}
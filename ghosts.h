@@ -0,0 +1,56 @@
+#ifndef GHOSTS_H
+#define GHOSTS_H
+
+#include <SDL2/SDL_render.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "game.h"
+#include "job_system.h"
+#include "replay.h"
+
+// Many replays played back together for spectating, each as a translucent
+// snake in its own colour. Every tick steps all ghosts in parallel on the
+// job system, then writes their quads into one shared vertex buffer so the
+// whole field is drawn with a single SDL_RenderGeometry call.
+
+#define GHOST_LIMIT 1000
+
+struct Ghost{
+    std::vector<uint8_t> data;  // The replay file; replay points into it
+    Replay replay;
+    ReplayCursor cursor;
+    Game game;
+    bool playing;
+    SDL_Color color;
+    uint32_t firstVertex;       // Where this ghost's quads start in the vertex buffer
+};
+
+struct GhostSet{
+    std::vector<Ghost> ghosts;  // Reserved for GHOST_LIMIT up front, so replays never move
+    JobSystem* jobs;
+    int cellSize;               // Pixels per cell
+    Uint8 alpha;
+    std::vector<SDL_Vertex> vertices;
+    std::vector<int> indices;   // Two triangles per quad, grown as needed and never rewritten
+    int quadCount;
+    int playingCount;
+};
+
+void initGhosts(GhostSet& set, JobSystem* jobs, int cellSize, Uint8 alpha);
+// Copies one replay file; false if it is invalid or the set is full
+bool addGhost(GhostSet& set, const uint8_t* data, size_t size);
+bool addGhostFile(GhostSet& set, const char* path);
+// Adds up to limit replays from an archive written by replay_stats --generate;
+// returns how many were added
+int addGhostArchive(GhostSet& set, const char* path, int limit);
+// Puts every ghost back at the start of its replay
+void restartGhosts(GhostSet& set);
+// Plays one tick of every ghost and rebuilds the vertex buffer; false once all have finished
+bool stepGhosts(GhostSet& set);
+
+// Times stepping and vertex building for the ghosts of an archive
+void runGhostBenchmark(const char* archivePath, int count, JobSystem* jobs);
+
+#endif
@@ -0,0 +1,101 @@
+#include "heatmap.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define HEATMAP_SSE2
+#endif
+
+using namespace std;
+
+struct HeatmapHeader{
+    char magic[4];
+    uint32_t version;
+    uint32_t cols, rows;
+};
+
+void clearHeatmap(Heatmap& heatmap) {
+    memset(&heatmap, 0, sizeof(heatmap));
+}
+
+static bool heatmapBoard(const Game& game) {
+    return game.cols == HEATMAP_COLS && game.rows == HEATMAP_ROWS && !game.snake.empty();
+}
+
+void addHeatmapVisit(Heatmap& heatmap, const Game& game) {
+    if (!heatmapBoard(game)) {
+        return;
+    }
+    const SnakeSegment& head = game.snake.front();
+    if (head.x >= 0 && head.x < HEATMAP_COLS && head.y >= 0 && head.y < HEATMAP_ROWS) {
+        heatmap.visits[head.y * HEATMAP_COLS + head.x]++;
+    }
+}
+
+void removeHeatmapVisit(Heatmap& heatmap, const Game& game) {
+    if (!heatmapBoard(game)) {
+        return;
+    }
+    const SnakeSegment& head = game.snake.front();
+    if (head.x >= 0 && head.x < HEATMAP_COLS && head.y >= 0 && head.y < HEATMAP_ROWS &&
+        heatmap.visits[head.y * HEATMAP_COLS + head.x] > 0) {
+        heatmap.visits[head.y * HEATMAP_COLS + head.x]--;
+    }
+}
+
+void addHeatmapDeath(Heatmap& heatmap, const Game& game) {
+    if (!heatmapBoard(game)) {
+        return;
+    }
+    int x = min(max(game.snake.front().x, 0), HEATMAP_COLS - 1);
+    int y = min(max(game.snake.front().y, 0), HEATMAP_ROWS - 1);
+    heatmap.deaths[y * HEATMAP_COLS + x]++;
+}
+
+static void addCounts(uint32_t* into, const uint32_t* from) {
+#ifdef HEATMAP_SSE2
+    for (int i = 0; i < HEATMAP_CELLS; i += 4) {
+        __m128i sum = _mm_add_epi32(_mm_loadu_si128((const __m128i*)(into + i)),
+                                    _mm_loadu_si128((const __m128i*)(from + i)));
+        _mm_storeu_si128((__m128i*)(into + i), sum);
+    }
+#else
+    for (int i = 0; i < HEATMAP_CELLS; ++i) {
+        into[i] += from[i];
+    }
+#endif
+}
+
+void mergeHeatmap(Heatmap& into, const Heatmap& from) {
+    addCounts(into.visits, from.visits);
+    addCounts(into.deaths, from.deaths);
+}
+
+string saveHeatmap(const Heatmap& heatmap) {
+    HeatmapHeader header;
+    memcpy(header.magic, HEATMAP_MAGIC, 4);
+    header.version = HEATMAP_VERSION;
+    header.cols = HEATMAP_COLS;
+    header.rows = HEATMAP_ROWS;
+    string data((const char*)&header, sizeof(header));
+    data.append((const char*)&heatmap, sizeof(heatmap));
+    return data;
+}
+
+bool loadHeatmap(Heatmap& heatmap, const string& path) {
+    ifstream file(path.c_str(), ios::binary);
+    HeatmapHeader header;
+    if (!file.read((char*)&header, sizeof(header)) || memcmp(header.magic, HEATMAP_MAGIC, 4) != 0 ||
+        header.version != HEATMAP_VERSION || header.cols != HEATMAP_COLS || header.rows != HEATMAP_ROWS) {
+        return false;
+    }
+    Heatmap loaded;
+    if (!file.read((char*)&loaded, sizeof(loaded))) {
+        return false;
+    }
+    heatmap = loaded;
+    return true;
+}
@@ -0,0 +1,39 @@
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+#include <cstdint>
+#include <string>
+
+#include "game.h"
+
+// Per-cell head visits and death locations on the classic 54x34 board.
+// Live games, replays and batch simulations each fill their own Heatmap
+// (one per thread for batch work) and mergeHeatmap sums them with SSE2
+// adds, four cells at a time.
+
+#define HEATMAP_COLS 54
+#define HEATMAP_ROWS 34
+#define HEATMAP_CELLS (HEATMAP_COLS * HEATMAP_ROWS)    // A multiple of 4
+#define HEATMAP_MAGIC "SHMP"
+#define HEATMAP_VERSION 1
+
+struct Heatmap{
+    uint32_t visits[HEATMAP_CELLS];
+    uint32_t deaths[HEATMAP_CELLS];
+};
+
+void clearHeatmap(Heatmap& heatmap);
+// Counts the cell the head is on; games on other board sizes are ignored
+void addHeatmapVisit(Heatmap& heatmap, const Game& game);
+// Takes back addHeatmapVisit for the same state, when a tick is rewound
+void removeHeatmapVisit(Heatmap& heatmap, const Game& game);
+// Counts where the snake died; a head past the border counts on the edge it crossed
+void addHeatmapDeath(Heatmap& heatmap, const Game& game);
+void mergeHeatmap(Heatmap& into, const Heatmap& from);
+
+// File form: magic, version, cols, rows, then visits and deaths
+std::string saveHeatmap(const Heatmap& heatmap);
+// Returns false (and leaves heatmap alone) if the file is missing or invalid
+bool loadHeatmap(Heatmap& heatmap, const std::string& path);
+
+#endif
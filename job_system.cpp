@@ -0,0 +1,375 @@
+#include "job_system.h"
+
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+#define JOB_DEQUE_CAPACITY 4096     // Per worker, power of two
+#define JOB_SPINS_BEFORE_PARK 64
+
+// Chase-Lev work-stealing deque with a fixed ring. Only the owning worker
+// calls pushJob/popJob; any thread may call stealJob.
+struct WorkDeque{
+    atomic<long long> top;
+    atomic<long long> bottom;
+    atomic<Job*> slots[JOB_DEQUE_CAPACITY];
+
+    WorkDeque() : top(0), bottom(0) {
+        for (int i = 0; i < JOB_DEQUE_CAPACITY; ++i) {
+            slots[i].store(NULL, memory_order_relaxed);
+        }
+    }
+};
+
+struct JobWorker{
+    JobSystem* system;
+    int index;
+    SDL_Thread* thread;
+    uint32_t rng;       // Picks steal victims
+    WorkDeque deque;
+};
+
+struct JobSystem{
+    vector<JobWorker*> workers;
+
+    SDL_mutex* injectedLock;
+    deque<Job*> injected;
+    atomic<int> injectedCount;  // Lets finders skip the lock when the queue is empty
+
+    SDL_mutex* parkLock;
+    SDL_cond* parkCond;
+    atomic<int> pendingJobs;    // Submitted but not yet taken by anyone
+    atomic<int> sleepers;
+    atomic<bool> stopping;
+};
+
+// Which worker of which system the current thread is, if any
+static thread_local JobWorker* currentWorker = NULL;
+
+static bool pushJob(WorkDeque& deque, Job* job) {
+    long long b = deque.bottom.load(memory_order_relaxed);
+    long long t = deque.top.load(memory_order_acquire);
+    if (b - t >= JOB_DEQUE_CAPACITY) {
+        return false;
+    }
+    deque.slots[b & (JOB_DEQUE_CAPACITY - 1)].store(job, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    deque.bottom.store(b + 1, memory_order_relaxed);
+    return true;
+}
+
+static Job* popJob(WorkDeque& deque) {
+    long long b = deque.bottom.load(memory_order_relaxed) - 1;
+    deque.bottom.store(b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long long t = deque.top.load(memory_order_relaxed);
+
+    if (t > b) {
+        deque.bottom.store(b + 1, memory_order_relaxed);
+        return NULL;
+    }
+    Job* job = deque.slots[b & (JOB_DEQUE_CAPACITY - 1)].load(memory_order_relaxed);
+    if (t == b) {
+        // Last item: race any thief for it
+        if (!deque.top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed)) {
+            job = NULL;
+        }
+        deque.bottom.store(b + 1, memory_order_relaxed);
+    }
+    return job;
+}
+
+static Job* stealJob(WorkDeque& deque) {
+    long long t = deque.top.load(memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long long b = deque.bottom.load(memory_order_acquire);
+    if (t >= b) {
+        return NULL;
+    }
+    Job* job = deque.slots[t & (JOB_DEQUE_CAPACITY - 1)].load(memory_order_relaxed);
+    if (!deque.top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed)) {
+        return NULL;
+    }
+    return job;
+}
+
+static void runJob(Job* job) {
+    job->function(job->data);
+    job->group->pending.fetch_sub(1, memory_order_release);
+}
+
+// Own deque first, then the injection queue, then steal from a random victim
+static Job* findJob(JobSystem* system, JobWorker* self) {
+    Job* job = NULL;
+    if (self != NULL) {
+        job = popJob(self->deque);
+    }
+
+    if (job == NULL && system->injectedCount.load(memory_order_acquire) > 0) {
+        SDL_LockMutex(system->injectedLock);
+        if (!system->injected.empty()) {
+            job = system->injected.front();
+            system->injected.pop_front();
+            system->injectedCount.fetch_sub(1, memory_order_relaxed);
+        }
+        SDL_UnlockMutex(system->injectedLock);
+    }
+
+    int workerCount = (int)system->workers.size();
+    if (job == NULL && workerCount > 0) {
+        uint32_t start = 0;
+        if (self != NULL) {
+            self->rng ^= self->rng << 13;
+            self->rng ^= self->rng >> 17;
+            self->rng ^= self->rng << 5;
+            start = self->rng;
+        }
+        for (int i = 0; i < workerCount && job == NULL; ++i) {
+            JobWorker* victim = system->workers[(start + i) % workerCount];
+            if (victim != self) {
+                job = stealJob(victim->deque);
+            }
+        }
+    }
+
+    if (job != NULL) {
+        system->pendingJobs.fetch_sub(1, memory_order_relaxed);
+    }
+    return job;
+}
+
+static int workerMain(void* data) {
+    JobWorker* self = (JobWorker*)data;
+    JobSystem* system = self->system;
+    currentWorker = self;
+
+    int idleSpins = 0;
+    while (!system->stopping.load(memory_order_acquire)) {
+        Job* job = findJob(system, self);
+        if (job != NULL) {
+            runJob(job);
+            idleSpins = 0;
+            continue;
+        }
+        if (++idleSpins < JOB_SPINS_BEFORE_PARK) {
+            continue;
+        }
+
+        // Park until a submit bumps pendingJobs. sleepers is raised before
+        // pendingJobs is checked, and submitters raise pendingJobs before
+        // checking sleepers, so a wakeup cannot be lost between the two.
+        SDL_LockMutex(system->parkLock);
+        system->sleepers.fetch_add(1);
+        while (system->pendingJobs.load() == 0 && !system->stopping.load()) {
+            SDL_CondWait(system->parkCond, system->parkLock);
+        }
+        system->sleepers.fetch_sub(1);
+        SDL_UnlockMutex(system->parkLock);
+        idleSpins = 0;
+    }
+
+    currentWorker = NULL;
+    return 0;
+}
+
+JobSystem* createJobSystem(int workerCount) {
+    JobSystem* system = new JobSystem();
+    system->injectedCount.store(0);
+    system->pendingJobs.store(0);
+    system->sleepers.store(0);
+    system->stopping.store(false);
+    system->injectedLock = SDL_CreateMutex();
+    system->parkLock = SDL_CreateMutex();
+    system->parkCond = SDL_CreateCond();
+    if (!system->injectedLock || !system->parkLock || !system->parkCond) {
+        cout << "Job system creation failed: " << SDL_GetError() << endl;
+        destroyJobSystem(system);
+        return NULL;
+    }
+
+    // Every worker exists before any thread starts stealing from the list
+    for (int i = 0; i < workerCount; ++i) {
+        JobWorker* worker = new JobWorker();
+        worker->system = system;
+        worker->index = i;
+        worker->thread = NULL;
+        worker->rng = 0x9E3779B9u * (uint32_t)(i + 1);
+        system->workers.push_back(worker);
+    }
+    for (int i = 0; i < workerCount; ++i) {
+        system->workers[i]->thread = SDL_CreateThread(workerMain, "job worker", system->workers[i]);
+        if (system->workers[i]->thread == NULL) {
+            cout << "Job worker creation failed: " << SDL_GetError() << endl;
+            destroyJobSystem(system);
+            return NULL;
+        }
+    }
+    return system;
+}
+
+void destroyJobSystem(JobSystem* system) {
+    if (system == NULL) {
+        return;
+    }
+    system->stopping.store(true);
+    if (system->parkLock) {
+        SDL_LockMutex(system->parkLock);
+        SDL_CondBroadcast(system->parkCond);
+        SDL_UnlockMutex(system->parkLock);
+    }
+    for (size_t i = 0; i < system->workers.size(); ++i) {
+        if (system->workers[i]->thread) {
+            SDL_WaitThread(system->workers[i]->thread, NULL);
+        }
+    }
+    for (size_t i = 0; i < system->workers.size(); ++i) {
+        delete system->workers[i];
+    }
+    if (system->parkCond) SDL_DestroyCond(system->parkCond);
+    if (system->parkLock) SDL_DestroyMutex(system->parkLock);
+    if (system->injectedLock) SDL_DestroyMutex(system->injectedLock);
+    delete system;
+}
+
+int jobWorkerCount(const JobSystem* system) {
+    return system ? (int)system->workers.size() : 0;
+}
+
+int defaultJobWorkerCount() {
+    int cores = SDL_GetCPUCount();
+    return cores > 1 ? cores - 1 : 0;
+}
+
+int currentJobWorker(const JobSystem* system) {
+    JobWorker* self = currentWorker;
+    return self != NULL && self->system == system ? self->index : -1;
+}
+
+void submitJob(JobSystem* system, Job* job) {
+    job->group->pending.fetch_add(1, memory_order_relaxed);
+    if (system == NULL || system->workers.empty()) {
+        runJob(job);
+        return;
+    }
+
+    system->pendingJobs.fetch_add(1);
+    JobWorker* self = currentWorker;
+    if (self == NULL || self->system != system || !pushJob(self->deque, job)) {
+        SDL_LockMutex(system->injectedLock);
+        system->injected.push_back(job);
+        system->injectedCount.fetch_add(1, memory_order_release);
+        SDL_UnlockMutex(system->injectedLock);
+    }
+
+    if (system->sleepers.load() > 0) {
+        SDL_LockMutex(system->parkLock);
+        SDL_CondSignal(system->parkCond);
+        SDL_UnlockMutex(system->parkLock);
+    }
+}
+
+void waitForJobGroup(JobSystem* system, JobGroup& group) {
+    JobWorker* self = currentWorker;
+    if (self != NULL && self->system != system) {
+        self = NULL;
+    }
+    while (group.pending.load(memory_order_acquire) > 0) {
+        Job* job = system ? findJob(system, self) : NULL;
+        if (job != NULL) {
+            runJob(job);
+        } else {
+            SDL_Delay(0);   // Remaining jobs are running elsewhere; give up the slice
+        }
+    }
+}
+
+struct ParallelForRange{
+    void (*function)(int begin, int end, void* data);
+    void* data;
+    int begin, end;
+};
+
+static void runParallelForRange(void* data) {
+    ParallelForRange* range = (ParallelForRange*)data;
+    range->function(range->begin, range->end, range->data);
+}
+
+void parallelFor(JobSystem* system, int count, int grain,
+                 void (*function)(int begin, int end, void* data), void* data) {
+    if (count <= 0) {
+        return;
+    }
+    if (grain < 1) {
+        grain = 1;
+    }
+    if (system == NULL || system->workers.empty() || count <= grain) {
+        function(0, count, data);
+        return;
+    }
+
+    int rangeCount = (count + grain - 1) / grain;
+    vector<ParallelForRange> ranges(rangeCount);
+    vector<Job> jobs(rangeCount);
+    JobGroup group;
+    for (int i = 0; i < rangeCount; ++i) {
+        ranges[i].function = function;
+        ranges[i].data = data;
+        ranges[i].begin = i * grain;
+        ranges[i].end = min(count, (i + 1) * grain);
+        jobs[i].function = runParallelForRange;
+        jobs[i].data = &ranges[i];
+        jobs[i].group = &group;
+    }
+    // Keep the first range for this thread, the rest go to the workers
+    for (int i = 1; i < rangeCount; ++i) {
+        submitJob(system, &jobs[i]);
+    }
+    runParallelForRange(&ranges[0]);
+    waitForJobGroup(system, group);
+}
+
+static void benchmarkWork(int begin, int end, void* data) {
+    uint32_t* results = (uint32_t*)data;
+    for (int i = begin; i < end; ++i) {
+        uint32_t x = (uint32_t)i + 1;
+        for (int k = 0; k < 2000; ++k) {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+        }
+        results[i] = x;
+    }
+}
+
+void runJobSystemBenchmark(int maxThreads) {
+    const int items = 1 << 16;
+    vector<uint32_t> results(items);
+    double baseline = 0;
+
+    cout << "Job system benchmark: " << items << " items, grain 64" << endl;
+    for (int threads = 1; threads <= maxThreads; ++threads) {
+        JobSystem* system = createJobSystem(threads - 1);
+        if (system == NULL) {
+            return;
+        }
+        parallelFor(system, items, 64, benchmarkWork, results.data());  // Warm up and wake workers
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for (int round = 0; round < 5; ++round) {
+            parallelFor(system, items, 64, benchmarkWork, results.data());
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count() / 5;
+        destroyJobSystem(system);
+
+        if (threads == 1) {
+            baseline = seconds;
+        }
+        cout << "  " << threads << " thread(s): " << seconds * 1000.0 << " ms, "
+             << items / seconds / 1e6 << " M items/s, speedup " << baseline / seconds << "x" << endl;
+    }
+}
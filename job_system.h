@@ -0,0 +1,52 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <atomic>
+
+// Small work-stealing thread pool shared by the arena AI, batch simulation,
+// replay tools and asset loading.
+//
+// Each worker owns a Chase-Lev deque: it pushes and pops its own jobs at
+// the bottom while idle workers steal from the top. Jobs submitted from a
+// thread that is not a worker go through a shared injection queue. Workers
+// park on a condition variable when there is nothing to run, and a thread
+// waiting on a JobGroup runs jobs itself instead of blocking.
+
+struct JobSystem;
+
+// Counts the unfinished jobs submitted against it
+struct JobGroup{
+    std::atomic<int> pending;
+    JobGroup() : pending(0) {}
+};
+
+// The caller owns the Job and must keep it alive until its group is done
+struct Job{
+    void (*function)(void* data);
+    void* data;
+    JobGroup* group;
+};
+
+// workerCount extra threads are started; 0 runs every job on the thread
+// that waits for it. Returns NULL if threads cannot be created.
+JobSystem* createJobSystem(int workerCount);
+void destroyJobSystem(JobSystem* system);
+int jobWorkerCount(const JobSystem* system);
+// Worker threads to start so that, with the calling thread, every core is busy
+int defaultJobWorkerCount();
+// Index of the calling thread among the system's workers, or -1 for any
+// other thread, so jobs can keep per-thread state without locks
+int currentJobWorker(const JobSystem* system);
+
+void submitJob(JobSystem* system, Job* job);
+void waitForJobGroup(JobSystem* system, JobGroup& group);
+
+// Splits [0, count) into ranges of at most grain items, runs them in
+// parallel and returns when all are done. A NULL system runs serially.
+void parallelFor(JobSystem* system, int count, int grain,
+                 void (*function)(int begin, int end, void* data), void* data);
+
+// Prints job throughput for 1..cores threads
+void runJobSystemBenchmark(int maxThreads);
+
+#endif
@@ -0,0 +1,284 @@
+#include "leaderboard.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+
+#include "file_util.h"
+
+using namespace std;
+
+#define LEADERBOARD_MAGIC "SLBD"
+#define LEADERBOARD_VERSION 1
+#define LEADERBOARD_MAX_SCORE (1 << 20)     // Ranks treat anything higher as this
+#define LEADERBOARD_MIN_COMPACT 1024
+
+struct LeaderboardHeader{
+    char magic[4];
+    uint32_t version;
+};
+
+static uint32_t entryChecksum(const LeaderboardEntry& entry) {
+    const unsigned char* bytes = (const unsigned char*)&entry;
+    uint32_t hash = 2166136261u;    // FNV-1a
+    for (size_t i = 0; i < offsetof(LeaderboardEntry, checksum); ++i) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Heap order: a sorts after b when it is the better game, so the root is
+// the weakest of the top games
+static bool betterEntry(const LeaderboardEntry& a, const LeaderboardEntry& b) {
+    if (a.score != b.score) {
+        return a.score > b.score;
+    }
+    return a.sequence < b.sequence;
+}
+
+static int rankSlot(int score) {
+    return min(max(score, 0), LEADERBOARD_MAX_SCORE - 1) + 1;
+}
+
+static void adjustRank(Leaderboard& board, int score, int delta) {
+    int size = (int)board.rankTree.size();
+    for (int i = rankSlot(score); i < size; i += i & -i) {
+        board.rankTree[i] += delta;
+    }
+}
+
+// Players whose best is at most score
+static uint32_t countRankAtMost(const Leaderboard& board, int score) {
+    uint32_t count = 0;
+    for (int i = min(rankSlot(score), (int)board.rankTree.size() - 1); i > 0; i -= i & -i) {
+        count += board.rankTree[i];
+    }
+    return count;
+}
+
+// The tree covers scores below its size; doubling it means rebuilding
+static void reserveRank(Leaderboard& board, int score) {
+    int needed = rankSlot(score) + 1;
+    if (needed < (int)board.rankTree.size()) {
+        return;
+    }
+    int size = max((int)board.rankTree.size(), 1024);
+    while (size <= needed) {
+        size *= 2;
+    }
+    board.rankTree.assign(size, 0);
+    for (auto& player : board.players) {
+        adjustRank(board, player.second.score, 1);
+    }
+}
+
+static void indexEntry(Leaderboard& board, const LeaderboardEntry& entry) {
+    if ((int)board.top.size() < LEADERBOARD_TOP) {
+        board.top.push_back(entry);
+        push_heap(board.top.begin(), board.top.end(), betterEntry);
+    } else if (betterEntry(entry, board.top.front())) {
+        pop_heap(board.top.begin(), board.top.end(), betterEntry);
+        board.top.back() = entry;
+        push_heap(board.top.begin(), board.top.end(), betterEntry);
+    }
+
+    reserveRank(board, entry.score);
+    auto found = board.players.find(entry.player);
+    if (found == board.players.end()) {
+        board.players[entry.player] = entry;
+        adjustRank(board, entry.score, 1);
+    } else if (betterEntry(entry, found->second)) {
+        adjustRank(board, found->second.score, -1);
+        adjustRank(board, entry.score, 1);
+        found->second = entry;
+    }
+    if (entry.replayId != 0) {
+        board.logReplays.push_back(entry.replayId);
+    }
+    board.nextSequence = max(board.nextSequence, entry.sequence + 1);
+}
+
+static string logHeader() {
+    LeaderboardHeader header;
+    memcpy(header.magic, LEADERBOARD_MAGIC, 4);
+    header.version = LEADERBOARD_VERSION;
+    return string((const char*)&header, sizeof(header));
+}
+
+// Rewrites the log with only what the indexes need: each player's best
+// and the top games, in recording order
+static void compactLeaderboard(Leaderboard& board, BackgroundWriter* writer) {
+    vector<LeaderboardEntry> kept;
+    kept.reserve(board.players.size() + board.top.size());
+    for (auto& player : board.players) {
+        kept.push_back(player.second);
+    }
+    kept.insert(kept.end(), board.top.begin(), board.top.end());
+    sort(kept.begin(), kept.end(), [](const LeaderboardEntry& a, const LeaderboardEntry& b) {
+        return a.sequence < b.sequence;
+    });
+    kept.erase(unique(kept.begin(), kept.end(), [](const LeaderboardEntry& a, const LeaderboardEntry& b) {
+        return a.sequence == b.sequence;
+    }), kept.end());
+
+    string data = logHeader();
+    data.append((const char*)kept.data(), kept.size() * sizeof(LeaderboardEntry));
+    queueFileReplace(*writer, board.path, data);
+    board.logRecords = (uint32_t)kept.size();
+
+    vector<uint32_t> keptReplays;
+    for (const LeaderboardEntry& entry : kept) {
+        if (entry.replayId != 0) {
+            keptReplays.push_back(entry.replayId);
+        }
+    }
+    sort(keptReplays.begin(), keptReplays.end());
+    for (uint32_t replayId : board.logReplays) {
+        if (!binary_search(keptReplays.begin(), keptReplays.end(), replayId)) {
+            board.droppedReplays.push_back(replayId);
+        }
+    }
+    board.logReplays.swap(keptReplays);
+}
+
+void loadLeaderboard(Leaderboard& board, const string& path, BackgroundWriter* writer) {
+    board.path = writer != NULL ? path : "";
+    board.top.clear();
+    board.players.clear();
+    board.rankTree.clear();
+    board.nextSequence = 1;
+    board.logRecords = 0;
+    board.logReplays.clear();
+    board.droppedReplays.clear();
+    if (path.empty()) {
+        return;
+    }
+
+    MappedFile file;
+    if (!mapFile(file, path.c_str())) {
+        return;     // No games recorded yet
+    }
+    size_t records = 0;
+    bool clean = file.size >= sizeof(LeaderboardHeader) &&
+                 memcmp(file.data, LEADERBOARD_MAGIC, 4) == 0 &&
+                 ((const LeaderboardHeader*)file.data)->version == LEADERBOARD_VERSION;
+    if (clean) {
+        size_t available = (file.size - sizeof(LeaderboardHeader)) / sizeof(LeaderboardEntry);
+        for (; records < available; ++records) {
+            LeaderboardEntry entry;
+            memcpy(&entry, file.data + sizeof(LeaderboardHeader) + records * sizeof(LeaderboardEntry), sizeof(entry));
+            if (entry.checksum != entryChecksum(entry) || entry.player[LEADERBOARD_NAME_LENGTH - 1] != '\0') {
+                break;
+            }
+            indexEntry(board, entry);
+        }
+        clean = sizeof(LeaderboardHeader) + records * sizeof(LeaderboardEntry) == file.size;
+    }
+    unmapFile(file);
+    board.logRecords = (uint32_t)records;
+
+    // A torn or foreign tail would misalign every later append, so rewrite
+    // the log from what was readable before recording anything new
+    if (!clean && writer != NULL) {
+        cout << "Leaderboard log " << path << " was damaged; kept " << records << " games" << endl;
+        compactLeaderboard(board, writer);
+    }
+}
+
+string leaderboardName(const string& player) {
+    return player.substr(0, min(player.find('\0'), (size_t)LEADERBOARD_NAME_LENGTH - 1));
+}
+
+uint32_t recordLeaderboardGame(Leaderboard& board, const string& player, int score, int length,
+                               uint32_t ticks, uint32_t replayId, BackgroundWriter* writer) {
+    LeaderboardEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    string name = leaderboardName(player);
+    memcpy(entry.player, name.c_str(), name.size());
+    entry.score = score;
+    entry.length = length;
+    entry.ticks = ticks;
+    entry.replayId = replayId;
+    entry.sequence = board.nextSequence;
+    entry.checksum = entryChecksum(entry);
+    indexEntry(board, entry);
+
+    if (writer != NULL && !board.path.empty()) {
+        string record((const char*)&entry, sizeof(entry));
+        if (board.logRecords == 0) {
+            queueFileReplace(*writer, board.path, logHeader() + record);
+        } else {
+            queueFileAppend(*writer, board.path, record);
+        }
+        board.logRecords++;
+
+        size_t retained = board.players.size() + board.top.size();
+        if (board.logRecords > max((size_t)LEADERBOARD_MIN_COMPACT, 2 * retained)) {
+            compactLeaderboard(board, writer);
+        }
+    }
+    return entry.sequence;
+}
+
+vector<LeaderboardEntry> leaderboardTop(const Leaderboard& board, int count) {
+    vector<LeaderboardEntry> best(board.top);
+    sort(best.begin(), best.end(), betterEntry);
+    if ((int)best.size() > count) {
+        best.resize(max(count, 0));
+    }
+    return best;
+}
+
+int leaderboardRank(const Leaderboard& board, const string& player) {
+    auto found = board.players.find(leaderboardName(player));
+    if (found == board.players.end()) {
+        return 0;
+    }
+    // Equal bests share a rank
+    return (int)(board.players.size() - countRankAtMost(board, found->second.score)) + 1;
+}
+
+int leaderboardPlayerCount(const Leaderboard& board) {
+    return (int)board.players.size();
+}
+
+void runLeaderboardBenchmark(int playerCount, int gameCount) {
+    Leaderboard board;
+    loadLeaderboard(board, "", NULL);
+    vector<string> names(max(playerCount, 1));
+    for (size_t i = 0; i < names.size(); ++i) {
+        names[i] = "player" + to_string(i);
+    }
+
+    uint32_t x = 2463534242u;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int i = 0; i < gameCount; ++i) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        int score = (int)(x % 2000) * 10;
+        recordLeaderboardGame(board, names[x % names.size()], score, score / 10 + 3, score, 0, NULL);
+    }
+    double insertSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    const int queries = 10000;
+    size_t checksum = 0;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < queries; ++i) {
+        checksum += leaderboardTop(board, LEADERBOARD_TOP).size();
+    }
+    double topSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < queries; ++i) {
+        checksum += leaderboardRank(board, names[i % names.size()]);
+    }
+    double rankSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << "Leaderboard benchmark: " << gameCount << " games, " << leaderboardPlayerCount(board) << " players" << endl;
+    cout << "  insert: " << insertSeconds * 1e6 / max(gameCount, 1) << " us/game" << endl;
+    cout << "  top " << LEADERBOARD_TOP << ": " << topSeconds * 1e6 / queries << " us/query" << endl;
+    cout << "  rank: " << rankSeconds * 1e6 / queries << " us/query (checksum " << checksum << ")" << endl;
+}
@@ -0,0 +1,65 @@
+#ifndef LEADERBOARD_H
+#define LEADERBOARD_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "background_writer.h"
+
+// Local leaderboard backed by an append-only log of finished games.
+//
+// Loading replays the log into three in-memory indexes: the LEADERBOARD_TOP
+// best games in a min-heap, each player's best game in a hash map, and a
+// Fenwick tree counting players per best score for ranks. A game is
+// recorded in O(log n) and appended to the log on the background writer.
+// Once the log holds far more games than the indexes need, it is
+// rewritten to just the top games and each player's best, and the replays
+// of the games it drops are handed back in droppedReplays.
+
+#define LEADERBOARD_TOP 100
+#define LEADERBOARD_NAME_LENGTH 24
+
+struct LeaderboardEntry{
+    char player[LEADERBOARD_NAME_LENGTH];   // NUL-terminated
+    int32_t score;
+    int32_t length;
+    uint32_t ticks;
+    uint32_t replayId;                      // 0 when the game was not recorded
+    uint32_t sequence;                      // Order of recording; earlier wins ties
+    uint32_t checksum;                      // Over the fields above, for torn log tails
+};
+
+struct Leaderboard{
+    std::string path;
+    std::vector<LeaderboardEntry> top;      // Min-heap on (score, -sequence)
+    std::unordered_map<std::string, LeaderboardEntry> players;   // Each player's best
+    std::vector<uint32_t> rankTree;         // Fenwick tree: players per best score
+    uint32_t nextSequence;
+    uint32_t logRecords;                    // Games in the log file right now
+    std::vector<uint32_t> logReplays;       // Replay ids the log file refers to
+    std::vector<uint32_t> droppedReplays;   // Ids compaction let go of; the caller deletes their files
+};
+
+// The name as the leaderboard stores it: cut to LEADERBOARD_NAME_LENGTH - 1
+// characters. Every function here normalises names this way.
+std::string leaderboardName(const std::string& player);
+
+// Rebuilds the indexes from the log at path (missing is fine, a torn tail
+// is ignored). With an empty path or no writer, new games stay in memory.
+void loadLeaderboard(Leaderboard& board, const std::string& path, BackgroundWriter* writer);
+// Indexes one finished game and appends it to the log; returns its sequence
+uint32_t recordLeaderboardGame(Leaderboard& board, const std::string& player, int score, int length,
+                               uint32_t ticks, uint32_t replayId, BackgroundWriter* writer);
+
+// Best count games, highest score first
+std::vector<LeaderboardEntry> leaderboardTop(const Leaderboard& board, int count);
+// 1-based rank of the player's best among all players, or 0 if unknown
+int leaderboardRank(const Leaderboard& board, const std::string& player);
+int leaderboardPlayerCount(const Leaderboard& board);
+
+// Times inserts and queries over synthetic players, in memory only
+void runLeaderboardBenchmark(int playerCount, int gameCount);
+
+#endif
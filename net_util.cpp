@@ -0,0 +1,207 @@
+#include "net_util.h"
+
+#include <iostream>
+#include <vector>
+
+#ifdef _WIN32
+#if !defined(_WIN32_WINNT) || _WIN32_WINNT < 0x0600
+#undef _WIN32_WINNT
+#define _WIN32_WINNT 0x0600     // For WSAPoll
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+#ifdef _WIN32
+typedef SOCKET NativeSocket;
+typedef WSAPOLLFD NativePoll;
+#define pollNative WSAPoll
+static bool wouldBlock() {
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+}
+#else
+typedef int NativeSocket;
+typedef pollfd NativePoll;
+#define pollNative poll
+#define INVALID_SOCKET (-1)
+static bool wouldBlock() {
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+}
+#endif
+
+bool initNetwork() {
+#ifdef _WIN32
+    static bool started = false;
+    if (!started) {
+        WSADATA data;
+        started = WSAStartup(MAKEWORD(2, 2), &data) == 0;
+        if (!started) {
+            cout << "Winsock initialization failed" << endl;
+        }
+    }
+    return started;
+#else
+    return true;
+#endif
+}
+
+static sockaddr_in localAddress(int port) {
+    sockaddr_in address = sockaddr_in();
+    address.sin_family = AF_INET;
+    address.sin_port = htons((unsigned short)port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return address;
+}
+
+static void disableNagle(NativeSocket socket) {
+    int on = 1;
+    setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+}
+
+bool setNonBlocking(SocketHandle socket) {
+#ifdef _WIN32
+    u_long on = 1;
+    return ioctlsocket((NativeSocket)socket, FIONBIO, &on) == 0;
+#else
+    int flags = fcntl((int)socket, F_GETFL, 0);
+    return flags != -1 && fcntl((int)socket, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+void closeSocket(SocketHandle socket) {
+    if (socket == NO_SOCKET) {
+        return;
+    }
+#ifdef _WIN32
+    closesocket((NativeSocket)socket);
+#else
+    close((int)socket);
+#endif
+}
+
+SocketHandle listenLocal(int port, int backlog) {
+    NativeSocket listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listener == INVALID_SOCKET) {
+        cout << "Unable to create a socket" << endl;
+        return NO_SOCKET;
+    }
+    int on = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&on, sizeof(on));
+    sockaddr_in address = localAddress(port);
+    if (bind(listener, (sockaddr*)&address, sizeof(address)) != 0 || listen(listener, backlog) != 0 ||
+        !setNonBlocking((SocketHandle)listener)) {
+        cout << "Unable to listen on 127.0.0.1:" << port << endl;
+        closeSocket((SocketHandle)listener);
+        return NO_SOCKET;
+    }
+    return (SocketHandle)listener;
+}
+
+SocketHandle acceptSocket(SocketHandle listener) {
+    NativeSocket client = accept((NativeSocket)listener, NULL, NULL);
+    if (client == INVALID_SOCKET) {
+        return NO_SOCKET;
+    }
+    if (!setNonBlocking((SocketHandle)client)) {
+        closeSocket((SocketHandle)client);
+        return NO_SOCKET;
+    }
+    disableNagle(client);
+    return (SocketHandle)client;
+}
+
+SocketHandle connectLocal(int port) {
+    NativeSocket client = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (client == INVALID_SOCKET) {
+        return NO_SOCKET;
+    }
+    sockaddr_in address = localAddress(port);
+    if (connect(client, (sockaddr*)&address, sizeof(address)) != 0) {
+        closeSocket((SocketHandle)client);
+        return NO_SOCKET;
+    }
+    disableNagle(client);
+    return (SocketHandle)client;
+}
+
+// Winsock has no socketpair, so this is a loopback connection on an ephemeral port
+bool socketPair(SocketHandle pair[2]) {
+    pair[0] = pair[1] = NO_SOCKET;
+    NativeSocket listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listener == INVALID_SOCKET) {
+        return false;
+    }
+    sockaddr_in address = localAddress(0);
+    socklen_t addressSize = sizeof(address);
+    bool bound = bind(listener, (sockaddr*)&address, sizeof(address)) == 0 && listen(listener, 1) == 0 &&
+                 getsockname(listener, (sockaddr*)&address, &addressSize) == 0;
+    if (bound) {
+        pair[0] = connectLocal(ntohs(address.sin_port));
+    }
+    if (pair[0] != NO_SOCKET) {
+        NativeSocket accepted = accept(listener, NULL, NULL);
+        pair[1] = accepted == INVALID_SOCKET ? NO_SOCKET : (SocketHandle)accepted;
+    }
+    closeSocket((SocketHandle)listener);
+    if (pair[1] == NO_SOCKET || !setNonBlocking(pair[0]) || !setNonBlocking(pair[1])) {
+        closeSocket(pair[0]);
+        closeSocket(pair[1]);
+        pair[0] = pair[1] = NO_SOCKET;
+        return false;
+    }
+    return true;
+}
+
+long sendSocket(SocketHandle socket, const void* data, size_t size) {
+#ifdef _WIN32
+    int sent = send((NativeSocket)socket, (const char*)data, (int)size, 0);
+#else
+    long sent = send((int)socket, data, size, MSG_NOSIGNAL);
+#endif
+    if (sent < 0) {
+        return wouldBlock() ? 0 : -1;
+    }
+    return sent;
+}
+
+long receiveSocket(SocketHandle socket, void* data, size_t size) {
+#ifdef _WIN32
+    int received = recv((NativeSocket)socket, (char*)data, (int)size, 0);
+#else
+    long received = recv((int)socket, data, size, 0);
+#endif
+    if (received == 0) {
+        return -1;  // Orderly shutdown
+    }
+    if (received < 0) {
+        return wouldBlock() ? 0 : -1;
+    }
+    return received;
+}
+
+int pollSockets(SocketPoll* polls, int count, int timeoutMs) {
+    static thread_local vector<NativePoll> native;
+    native.resize(count);
+    for (int i = 0; i < count; ++i) {
+        native[i].fd = (NativeSocket)polls[i].socket;
+        native[i].events = POLLIN | (polls[i].wantWrite ? POLLOUT : 0);
+        native[i].revents = 0;
+    }
+    int ready = pollNative(native.data(), count, timeoutMs);
+    for (int i = 0; i < count; ++i) {
+        polls[i].readable = ready > 0 && (native[i].revents & (POLLIN | POLLHUP | POLLERR)) != 0;
+        polls[i].writable = ready > 0 && (native[i].revents & POLLOUT) != 0;
+    }
+    return ready;
+}
@@ -0,0 +1,42 @@
+#ifndef NET_UTIL_H
+#define NET_UTIL_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Thin wrapper over Winsock and BSD sockets for the local TCP features:
+// everything listens on and connects to 127.0.0.1 only. Sockets are kept
+// as an integer so callers never include the platform headers.
+
+typedef intptr_t SocketHandle;
+#define NO_SOCKET ((SocketHandle)-1)
+
+// Call once before any other function here; starts Winsock on Windows
+bool initNetwork();
+
+// Non-blocking listener on 127.0.0.1:port, or NO_SOCKET (the reason is printed)
+SocketHandle listenLocal(int port, int backlog);
+// Next pending connection as a non-blocking socket with Nagle off, or NO_SOCKET when there is none
+SocketHandle acceptSocket(SocketHandle listener);
+// Blocking connection to 127.0.0.1:port with Nagle off, or NO_SOCKET
+SocketHandle connectLocal(int port);
+// Two connected non-blocking sockets, for waking a thread blocked in pollSockets
+bool socketPair(SocketHandle pair[2]);
+bool setNonBlocking(SocketHandle socket);
+void closeSocket(SocketHandle socket);
+
+// Bytes moved, 0 when the call would block, -1 once the peer has gone or the socket failed
+long sendSocket(SocketHandle socket, const void* data, size_t size);
+long receiveSocket(SocketHandle socket, void* data, size_t size);
+
+struct SocketPoll{
+    SocketHandle socket;
+    bool wantWrite;     // Also wake when it can be written to
+    bool readable;      // Results: data, a connection to accept, or a hang-up to read
+    bool writable;
+};
+
+// Waits up to timeoutMs (-1 for as long as it takes) for any socket to become ready; returns how many are
+int pollSockets(SocketPoll* polls, int count, int timeoutMs);
+
+#endif
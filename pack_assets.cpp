@@ -0,0 +1,85 @@
+// Builds the asset pack read by openAssetPack():
+//     pack_assets assets.pak font11.ttf mainmenu.jpg gameplay.jpg eat.mp3 gOver.wav
+// Entries are stored under their file name without directories.
+
+#include "asset_pack.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+static uint64_t alignUp(uint64_t value) {
+    return (value + ASSET_PACK_ALIGNMENT - 1) / ASSET_PACK_ALIGNMENT * ASSET_PACK_ALIGNMENT;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        cout << "Usage: " << argv[0] << " <output.pak> <file>..." << endl;
+        return 1;
+    }
+
+    vector<vector<char> > contents;
+    vector<AssetPackEntry> entries;
+    for (int i = 2; i < argc; ++i) {
+        string path = argv[i];
+        ifstream input(path.c_str(), ios::binary);
+        if (!input) {
+            cout << "Unable to read " << path << endl;
+            return 1;
+        }
+        contents.push_back(vector<char>((istreambuf_iterator<char>(input)), istreambuf_iterator<char>()));
+
+        string name = path.substr(path.find_last_of("/\\") + 1);
+        if (name.size() >= ASSET_PACK_NAME_LENGTH) {
+            cout << "Asset name too long: " << name << endl;
+            return 1;
+        }
+        AssetPackEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        memcpy(entry.name, name.c_str(), name.size());
+        entry.size = contents.back().size();
+        entries.push_back(entry);
+    }
+
+    uint64_t offset = alignUp(sizeof(AssetPackHeader) + entries.size() * sizeof(AssetPackEntry));
+    for (size_t i = 0; i < entries.size(); ++i) {
+        entries[i].offset = offset;
+        offset = alignUp(offset + entries[i].size);
+    }
+
+    AssetPackHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ASSET_PACK_MAGIC, 4);
+    header.version = ASSET_PACK_VERSION;
+    header.entryCount = (uint32_t)entries.size();
+
+    ofstream output(argv[1], ios::binary | ios::trunc);
+    if (!output) {
+        cout << "Unable to write " << argv[1] << endl;
+        return 1;
+    }
+    output.write((const char*)&header, sizeof(header));
+    output.write((const char*)entries.data(), entries.size() * sizeof(AssetPackEntry));
+
+    uint64_t written = sizeof(header) + entries.size() * sizeof(AssetPackEntry);
+    const char padding[ASSET_PACK_ALIGNMENT] = { 0 };
+    for (size_t i = 0; i < entries.size(); ++i) {
+        output.write(padding, (streamsize)(entries[i].offset - written));
+        output.write(contents[i].data(), (streamsize)contents[i].size());
+        written = entries[i].offset + entries[i].size;
+        cout << "  " << entries[i].name << " " << entries[i].size << " bytes at " << entries[i].offset << endl;
+    }
+    output.write(padding, (streamsize)(offset - written));
+
+    if (!output) {
+        cout << "Failed writing " << argv[1] << endl;
+        return 1;
+    }
+    cout << "Packed " << entries.size() << " assets into " << argv[1] << " (" << offset << " bytes)" << endl;
+    return 0;
+}
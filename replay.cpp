@@ -0,0 +1,451 @@
+#include "replay.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+static const char replayDirections[4] = { 'U', 'D', 'L', 'R' };
+
+static void writeVarint(string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back((char)((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back((char)value);
+}
+
+static bool readVarint(const uint8_t* data, uint32_t size, uint32_t& offset, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && offset < size; shift += 7) {
+        uint8_t byte = data[offset++];
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename T>
+static void appendRaw(string& out, const T& value) {
+    out.append((const char*)&value, sizeof(value));
+}
+
+void startReplayRecording(ReplayRecorder& recorder, const Game& game, int keyframeInterval) {
+    snapshotGame(game, recorder.initial);
+    recorder.startTick = game.tick;
+    recorder.initialDirection = game.direction;
+    recorder.direction = game.direction;
+    recorder.events.clear();
+    recorder.keyframes.clear();
+    recorder.keyframeInterval = max(keyframeInterval, 0);
+}
+
+void recordReplayStep(ReplayRecorder& recorder, const Game& game) {
+    if (recorder.keyframeInterval > 0 && game.tick > recorder.startTick &&
+        (game.tick - recorder.startTick) % recorder.keyframeInterval == 0 &&
+        (recorder.keyframes.empty() || recorder.keyframes.back().tick < game.tick)) {
+        ReplayKeyframe keyframe;
+        keyframe.tick = game.tick;
+        keyframe.eventIndex = (uint32_t)recorder.events.size();
+        if (game.direction == recorder.direction) {
+            snapshotGame(game, keyframe.snapshot);
+        } else {
+            // Keyframes hold the state the last step left, before this tick's input
+            Game before = game;
+            before.direction = recorder.direction;
+            snapshotGame(before, keyframe.snapshot);
+        }
+        recorder.keyframes.push_back(keyframe);
+    }
+    if (game.direction != recorder.direction) {
+        ReplayEvent event = { game.tick, game.direction };
+        recorder.events.push_back(event);
+        recorder.direction = game.direction;
+    }
+}
+
+void truncateReplayRecording(ReplayRecorder& recorder, uint32_t tick) {
+    while (!recorder.events.empty() && recorder.events.back().tick >= tick) {
+        recorder.events.pop_back();
+    }
+    while (!recorder.keyframes.empty() && recorder.keyframes.back().tick >= tick) {
+        recorder.keyframes.pop_back();
+    }
+    recorder.direction = recorder.events.empty() ? recorder.initialDirection : recorder.events.back().direction;
+}
+
+string finishReplay(const ReplayRecorder& recorder, uint32_t endTick) {
+    // Events, remembering where each keyframe's events start
+    string events;
+    vector<uint32_t> eventOffsets;
+    uint32_t lastTick = recorder.startTick;
+    for (size_t i = 0; i < recorder.events.size(); ++i) {
+        eventOffsets.push_back((uint32_t)events.size());
+        const ReplayEvent& event = recorder.events[i];
+        uint64_t code = find(replayDirections, replayDirections + 4, event.direction) - replayDirections;
+        writeVarint(events, (uint64_t)(event.tick - lastTick) << 2 | code);
+        lastTick = event.tick;
+    }
+    eventOffsets.push_back((uint32_t)events.size());
+
+    ReplayHeader header;
+    memcpy(header.magic, REPLAY_MAGIC, 4);
+    header.version = REPLAY_VERSION;
+    header.initialSize = (uint32_t)recorder.initial.size();
+    header.eventBytes = (uint32_t)events.size();
+    header.eventCount = (uint32_t)recorder.events.size();
+    header.startTick = recorder.startTick;
+    header.endTick = endTick;
+
+    string out;
+    appendRaw(out, header);
+    out.append(recorder.initial.begin(), recorder.initial.end());
+    out += events;
+    if (recorder.keyframeInterval == 0) {
+        return out;
+    }
+
+    vector<ReplayIndexEntry> index;
+    for (size_t i = 0; i < recorder.keyframes.size(); ++i) {
+        const ReplayKeyframe& keyframe = recorder.keyframes[i];
+        if (keyframe.tick > endTick) {
+            break;
+        }
+        ReplayIndexEntry entry;
+        entry.tick = keyframe.tick;
+        entry.eventOffset = eventOffsets[keyframe.eventIndex];
+        entry.lastEventTick = keyframe.eventIndex > 0 ? recorder.events[keyframe.eventIndex - 1].tick : recorder.startTick;
+        entry.snapshotOffset = (uint32_t)out.size();
+        entry.snapshotSize = (uint32_t)keyframe.snapshot.size();
+        out.append(keyframe.snapshot.begin(), keyframe.snapshot.end());
+        index.push_back(entry);
+    }
+
+    ReplayFooter footer;
+    memcpy(footer.magic, REPLAY_INDEX_MAGIC, 4);
+    footer.keyframeCount = (uint32_t)index.size();
+    footer.indexOffset = (uint32_t)out.size();
+    footer.keyframeInterval = (uint32_t)recorder.keyframeInterval;
+    out.append((const char*)index.data(), index.size() * sizeof(ReplayIndexEntry));
+    appendRaw(out, footer);
+    return out;
+}
+
+static bool parseReplay(Replay& replay, const uint8_t* data, size_t size) {
+    replay.header = NULL;
+    replay.index = NULL;
+    replay.keyframeCount = 0;
+
+    const ReplayHeader* header = (const ReplayHeader*)data;
+    if (size < sizeof(ReplayHeader) || memcmp(header->magic, REPLAY_MAGIC, 4) != 0 ||
+        header->version != REPLAY_VERSION || header->startTick > header->endTick ||
+        (uint64_t)header->initialSize + header->eventBytes > size - sizeof(ReplayHeader)) {
+        return false;
+    }
+    replay.data = data;
+    replay.initial = data + sizeof(ReplayHeader);
+    replay.events = replay.initial + header->initialSize;
+    replay.header = header;
+
+    // The index is optional; a damaged one is ignored rather than trusted
+    size_t bodyEnd = sizeof(ReplayHeader) + header->initialSize + header->eventBytes;
+    if (size - bodyEnd < sizeof(ReplayFooter)) {
+        return true;
+    }
+    const ReplayFooter* footer = (const ReplayFooter*)(data + size - sizeof(ReplayFooter));
+    if (memcmp(footer->magic, REPLAY_INDEX_MAGIC, 4) != 0 || footer->indexOffset < bodyEnd ||
+        (uint64_t)footer->indexOffset + (uint64_t)footer->keyframeCount * sizeof(ReplayIndexEntry) !=
+            size - sizeof(ReplayFooter)) {
+        return true;
+    }
+    const ReplayIndexEntry* index = (const ReplayIndexEntry*)(data + footer->indexOffset);
+    for (uint32_t i = 0; i < footer->keyframeCount; ++i) {
+        if (index[i].snapshotOffset < bodyEnd || index[i].snapshotSize > footer->indexOffset - index[i].snapshotOffset ||
+            index[i].eventOffset > header->eventBytes || index[i].tick < header->startTick ||
+            index[i].tick > header->endTick || (i > 0 && index[i].tick <= index[i - 1].tick)) {
+            return true;
+        }
+    }
+    replay.index = index;
+    replay.keyframeCount = footer->keyframeCount;
+    return true;
+}
+
+bool openReplayData(Replay& replay, const uint8_t* data, size_t size) {
+    memset(&replay.file, 0, sizeof(replay.file));
+    return parseReplay(replay, data, size);
+}
+
+bool openReplay(Replay& replay, const char* path) {
+    replay.header = NULL;
+    if (!mapFile(replay.file, path)) {
+        return false;
+    }
+    if (!parseReplay(replay, replay.file.data, replay.file.size)) {
+        cout << "Ignoring invalid replay " << path << endl;
+        unmapFile(replay.file);
+        return false;
+    }
+    return true;
+}
+
+void closeReplay(Replay& replay) {
+    unmapFile(replay.file);
+    replay.header = NULL;
+    replay.index = NULL;
+    replay.keyframeCount = 0;
+}
+
+// Decodes the next event into the cursor, if there is one
+static void readNextEvent(const Replay& replay, ReplayCursor& cursor) {
+    uint64_t value;
+    cursor.havePending = readVarint(replay.events, replay.header->eventBytes, cursor.offset, value);
+    if (cursor.havePending) {
+        cursor.pendingTick = cursor.lastEventTick + (uint32_t)(value >> 2);
+        cursor.pendingDirection = replayDirections[value & 3];
+        cursor.lastEventTick = cursor.pendingTick;
+    }
+}
+
+bool stepReplay(const Replay& replay, ReplayCursor& cursor, Game& game) {
+    if (game.tick >= replay.header->endTick) {
+        return false;
+    }
+    while (cursor.havePending && cursor.pendingTick <= game.tick) {
+        game.direction = cursor.pendingDirection;
+        readNextEvent(replay, cursor);
+    }
+    stepGame(game);
+    return true;
+}
+
+bool seekReplay(const Replay& replay, uint32_t tick, Game& game, ReplayCursor& cursor) {
+    const ReplayHeader* header = replay.header;
+    if (header == NULL || tick < header->startTick || tick > header->endTick) {
+        return false;
+    }
+
+    const uint8_t* snapshot = replay.initial;
+    uint32_t snapshotSize = header->initialSize;
+    cursor.offset = 0;
+    cursor.lastEventTick = header->startTick;
+    if (replay.keyframeCount > 0 && tick >= replay.index[0].tick) {
+        // Last keyframe at or before tick
+        const ReplayIndexEntry* entry = upper_bound(replay.index, replay.index + replay.keyframeCount, tick,
+            [](uint32_t t, const ReplayIndexEntry& e) { return t < e.tick; }) - 1;
+        snapshot = replay.data + entry->snapshotOffset;
+        snapshotSize = entry->snapshotSize;
+        cursor.offset = entry->eventOffset;
+        cursor.lastEventTick = entry->lastEventTick;
+    }
+    if (!restoreGame(game, snapshot, snapshotSize)) {
+        return false;
+    }
+    readNextEvent(replay, cursor);
+    while (game.tick < tick && stepReplay(replay, cursor, game)) {
+    }
+    return game.tick == tick;
+}
+
+bool openReplayReader(ReplayReader& reader, const char* path, Game& game) {
+    reader.file.close();
+    reader.file.clear();
+    reader.file.open(path, ios::binary);
+    ReplayHeader& header = reader.header;
+    if (!reader.file.read((char*)&header, sizeof(header)) || memcmp(header.magic, REPLAY_MAGIC, 4) != 0 ||
+        header.version != REPLAY_VERSION || header.startTick > header.endTick ||
+        header.initialSize > REPLAY_READ_BUFFER) {
+        reader.file.close();
+        return false;
+    }
+    // The initial snapshot passes through the buffer too, so memory is fixed
+    if (!reader.file.read((char*)reader.buffer, header.initialSize) ||
+        !restoreGame(game, reader.buffer, header.initialSize)) {
+        reader.file.close();
+        return false;
+    }
+    reader.bufferStart = 0;
+    reader.bufferEnd = 0;
+    reader.eventBytesLeft = header.eventBytes;
+    reader.lastEventTick = header.startTick;
+    reader.havePending = false;
+    return true;
+}
+
+// Decodes the next event from the buffer, refilling it from the file first
+// if a varint might straddle the end
+static void readNextReaderEvent(ReplayReader& reader) {
+    if (reader.bufferEnd - reader.bufferStart < 10 && reader.eventBytesLeft > 0) {
+        uint32_t kept = reader.bufferEnd - reader.bufferStart;
+        memmove(reader.buffer, reader.buffer + reader.bufferStart, kept);
+        uint32_t wanted = min((uint32_t)REPLAY_READ_BUFFER - kept, reader.eventBytesLeft);
+        reader.file.read((char*)reader.buffer + kept, wanted);
+        uint32_t got = (uint32_t)reader.file.gcount();
+        reader.eventBytesLeft = got == wanted ? reader.eventBytesLeft - got : 0;   // A short file just ends early
+        reader.bufferStart = 0;
+        reader.bufferEnd = kept + got;
+    }
+    uint64_t value;
+    reader.havePending = readVarint(reader.buffer, reader.bufferEnd, reader.bufferStart, value);
+    if (reader.havePending) {
+        reader.pendingTick = reader.lastEventTick + (uint32_t)(value >> 2);
+        reader.pendingDirection = replayDirections[value & 3];
+        reader.lastEventTick = reader.pendingTick;
+    }
+}
+
+bool stepReplayReader(ReplayReader& reader, Game& game) {
+    if (!reader.file.is_open() || game.tick >= reader.header.endTick) {
+        return false;
+    }
+    if (!reader.havePending) {
+        readNextReaderEvent(reader);
+    }
+    while (reader.havePending && reader.pendingTick <= game.tick) {
+        game.direction = reader.pendingDirection;
+        readNextReaderEvent(reader);
+    }
+    stepGame(game);
+    return true;
+}
+
+// Last keyframe at or before tick, by a binary search that reads only the index entries it probes
+static bool findReaderKeyframe(ReplayReader& reader, uint32_t tick, ReplayIndexEntry& entry) {
+    ReplayFooter footer;
+    reader.file.clear();
+    if (!reader.file.seekg(-(streamoff)sizeof(footer), ios::end) || !reader.file.read((char*)&footer, sizeof(footer)) ||
+        memcmp(footer.magic, REPLAY_INDEX_MAGIC, 4) != 0) {
+        return false;
+    }
+    bool found = false;
+    uint32_t low = 0, high = footer.keyframeCount;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        ReplayIndexEntry probe;
+        if (!reader.file.seekg((streamoff)footer.indexOffset + (streamoff)middle * sizeof(probe)) ||
+            !reader.file.read((char*)&probe, sizeof(probe))) {
+            return false;
+        }
+        if (probe.tick <= tick) {
+            entry = probe;
+            found = true;
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return found && entry.snapshotSize <= REPLAY_READ_BUFFER && entry.eventOffset <= reader.header.eventBytes;
+}
+
+bool seekReplayReader(ReplayReader& reader, uint32_t tick, Game& game) {
+    const ReplayHeader& header = reader.header;
+    if (!reader.file.is_open() || tick < header.startTick || tick > header.endTick) {
+        return false;
+    }
+
+    uint32_t snapshotOffset = sizeof(ReplayHeader);
+    uint32_t snapshotSize = header.initialSize;
+    uint32_t eventOffset = 0;
+    uint32_t lastEventTick = header.startTick;
+    ReplayIndexEntry entry;
+    if (findReaderKeyframe(reader, tick, entry)) {
+        snapshotOffset = entry.snapshotOffset;
+        snapshotSize = entry.snapshotSize;
+        eventOffset = entry.eventOffset;
+        lastEventTick = entry.lastEventTick;
+    }
+    reader.file.clear();
+    streamoff events = (streamoff)sizeof(ReplayHeader) + header.initialSize;
+    if (!reader.file.seekg(snapshotOffset) || !reader.file.read((char*)reader.buffer, snapshotSize) ||
+        !restoreGame(game, reader.buffer, snapshotSize) || !reader.file.seekg(events + eventOffset)) {
+        reader.file.close();
+        return false;
+    }
+    reader.bufferStart = 0;
+    reader.bufferEnd = 0;
+    reader.eventBytesLeft = header.eventBytes - eventOffset;
+    reader.lastEventTick = lastEventTick;
+    reader.havePending = false;
+    while (game.tick < tick && stepReplayReader(reader, game)) {
+    }
+    return game.tick == tick;
+}
+
+void closeReplayReader(ReplayReader& reader) {
+    reader.file.close();
+}
+
+// Follows a cycle through every cell (rows must be even), so it never dies
+// before the board is full. Odd rows run right and even rows left, joined
+// up the right edge and column 1, with column 0 leading back down.
+static char cycleDirection(const Game& game) {
+    int x = game.snake.front().x;
+    int y = game.snake.front().y;
+    if (x == 0) {
+        return y == game.rows - 1 ? 'R' : 'D';
+    }
+    if (y % 2 == 1) {
+        return x < game.cols - 1 ? 'R' : 'U';
+    }
+    return x > 1 || y == 0 ? 'L' : 'U';
+}
+
+void runReplaySeekBenchmark(int cols, int rows, int ticks) {
+    Game game;
+    initGame(game, cols, rows & ~1, 3, 12345);
+    ReplayRecorder recorder;
+    startReplayRecording(recorder, game, REPLAY_KEYFRAME_INTERVAL);
+    while ((int)game.tick < ticks && !game.over) {
+        setGameDirection(game, cycleDirection(game));
+        recordReplayStep(recorder, game);
+        stepGame(game);
+    }
+    string indexed = finishReplay(recorder, game.tick);
+    recorder.keyframeInterval = 0;
+    string plain = finishReplay(recorder, game.tick);
+    cout << "Replay seek benchmark: " << game.tick << " ticks, " << recorder.events.size() << " turns, length "
+         << game.snake.size() << endl;
+
+    const string* files[2] = { &plain, &indexed };
+    for (int f = 0; f < 2; ++f) {
+        Replay replay;
+        if (!openReplayData(replay, (const uint8_t*)files[f]->data(), files[f]->size())) {
+            cout << "  replay did not open" << endl;
+            return;
+        }
+        int seeks = replay.keyframeCount > 0 ? 2000 : 20;
+        uint32_t x = 2463534242u;
+        double worst = 0, total = 0;
+        bool exact = true;
+        for (int i = 0; i < seeks; ++i) {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            uint32_t target = replay.header->startTick + x % (replay.header->endTick - replay.header->startTick + 1);
+            Game seeked;
+            ReplayCursor cursor;
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            exact = seekReplay(replay, target, seeked, cursor) && exact;
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            total += seconds;
+            worst = max(worst, seconds);
+        }
+        // The end of the replay must be the game that was recorded
+        Game last;
+        ReplayCursor cursor;
+        exact = seekReplay(replay, replay.header->endTick, last, cursor) && exact;
+        vector<uint8_t> expected, actual;
+        snapshotGame(game, expected);
+        snapshotGame(last, actual);
+        exact = exact && expected == actual;
+
+        cout << "  " << (f == 0 ? "input only" : "indexed") << " (" << files[f]->size() << " bytes): "
+             << total * 1e6 / seeks << " us average, " << worst * 1e6 << " us worst"
+             << (exact ? "" : " (MISMATCH)") << endl;
+        closeReplay(replay);
+    }
+}
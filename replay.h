@@ -0,0 +1,155 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "file_util.h"
+#include "game.h"
+
+// Input-only replays of the classic game. A replay is the snapshot the
+// game started from plus every direction change, so a finished game costs
+// a few bytes per turn. Playing it back re-simulates with stepGame.
+//
+// An optional footer indexes full snapshots taken every keyframeInterval
+// ticks. Seeking to a tick restores the keyframe at or before it and
+// re-simulates at most keyframeInterval ticks, however long the replay.
+// Without the footer, seeking re-simulates from the start.
+//
+// Layout (little-endian):
+//   ReplayHeader, initial snapshot, direction changes as varints of
+//   (ticks since the previous change << 2 | direction),
+//   then optionally: keyframe snapshots, ReplayIndexEntry[], ReplayFooter
+
+#define REPLAY_MAGIC "SRPL"
+#define REPLAY_INDEX_MAGIC "SRKI"
+#define REPLAY_VERSION 1
+#define REPLAY_KEYFRAME_INTERVAL 256
+#define REPLAY_READ_BUFFER 4096
+#define REPLAY_ARCHIVE_MAGIC "SRPA"
+#define REPLAY_ARCHIVE_VERSION 1
+
+struct ReplayHeader{
+    char magic[4];
+    uint32_t version;
+    uint32_t initialSize;   // Bytes of the initial snapshot
+    uint32_t eventBytes;
+    uint32_t eventCount;
+    uint32_t startTick;
+    uint32_t endTick;
+};
+
+struct ReplayIndexEntry{
+    uint32_t tick;
+    uint32_t eventOffset;       // First event at or after tick, from the start of the events
+    uint32_t lastEventTick;     // Tick the events before eventOffset left off at
+    uint32_t snapshotOffset;    // From the start of the file
+    uint32_t snapshotSize;
+};
+
+struct ReplayFooter{
+    char magic[4];
+    uint32_t keyframeCount;
+    uint32_t indexOffset;       // From the start of the file
+    uint32_t keyframeInterval;
+};
+
+// Many replays in one file: this header, then each replay prefixed with
+// its size as a uint32_t
+struct ReplayArchiveHeader{
+    char magic[4];
+    uint32_t version;
+};
+
+struct ReplayEvent{
+    uint32_t tick;              // game.tick before the step it steers
+    char direction;
+};
+
+struct ReplayKeyframe{
+    uint32_t tick;
+    uint32_t eventIndex;        // Events recorded before this keyframe
+    std::vector<uint8_t> snapshot;
+};
+
+struct ReplayRecorder{
+    std::vector<uint8_t> initial;
+    uint32_t startTick;
+    char initialDirection;
+    char direction;             // In effect after the last recorded event
+    std::vector<ReplayEvent> events;
+    std::vector<ReplayKeyframe> keyframes;
+    int keyframeInterval;       // 0 writes no index
+};
+
+// Starts recording from the current state of game
+void startReplayRecording(ReplayRecorder& recorder, const Game& game, int keyframeInterval);
+// Call right before every stepGame
+void recordReplayStep(ReplayRecorder& recorder, const Game& game);
+// Forgets what was recorded from tick on, after the game was rewound there
+void truncateReplayRecording(ReplayRecorder& recorder, uint32_t tick);
+// The replay file for a game that has reached endTick
+std::string finishReplay(const ReplayRecorder& recorder, uint32_t endTick);
+
+struct Replay{
+    MappedFile file;            // Empty when opened from memory
+    const ReplayHeader* header;
+    const uint8_t* initial;
+    const uint8_t* events;
+    const uint8_t* data;
+    const ReplayIndexEntry* index;
+    uint32_t keyframeCount;     // 0 without an index
+};
+
+// Where playback is in the event stream
+struct ReplayCursor{
+    uint32_t offset;            // Next undecoded event byte
+    uint32_t lastEventTick;
+    bool havePending;
+    uint32_t pendingTick;
+    char pendingDirection;
+};
+
+// Returns false (and leaves the replay empty) if the file is missing or invalid
+bool openReplay(Replay& replay, const char* path);
+// Same over bytes the caller keeps alive while the replay is open
+bool openReplayData(Replay& replay, const uint8_t* data, size_t size);
+void closeReplay(Replay& replay);
+
+// Puts game at tick (startTick..endTick) and the cursor just after it
+bool seekReplay(const Replay& replay, uint32_t tick, Game& game, ReplayCursor& cursor);
+// Plays one tick; false once the replay has ended
+bool stepReplay(const Replay& replay, ReplayCursor& cursor, Game& game);
+
+// Plays a replay file forward from disk through a fixed buffer, for when
+// the whole file should not be in memory. Seeking reads only the footer
+// entries it needs and one keyframe.
+struct ReplayReader{
+    std::ifstream file;
+    ReplayHeader header;
+    uint8_t buffer[REPLAY_READ_BUFFER];
+    uint32_t bufferStart, bufferEnd;
+    uint32_t eventBytesLeft;        // Not yet pulled into the buffer
+    uint32_t lastEventTick;
+    bool havePending;
+    uint32_t pendingTick;
+    char pendingDirection;
+};
+
+// Reads the header and initial snapshot into game; false if the file is
+// missing or invalid
+bool openReplayReader(ReplayReader& reader, const char* path, Game& game);
+// Plays one tick, pulling events from the file as needed; false once the replay has ended
+bool stepReplayReader(ReplayReader& reader, Game& game);
+// Puts game at tick (startTick..endTick) from the nearest keyframe at or
+// before it, or from the start without an index; false closes the reader
+bool seekReplayReader(ReplayReader& reader, uint32_t tick, Game& game);
+void closeReplayReader(ReplayReader& reader);
+
+// Records a long bot game and times seeks with and without the index
+void runReplaySeekBenchmark(int cols, int rows, int ticks);
+
+#endif
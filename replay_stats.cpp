@@ -0,0 +1,448 @@
+// Aggregate statistics over a replay archive:
+//     replay_stats [--threads N] [--heatmap out.hmp] <archive.rpa | replay.rpl>...
+//     replay_stats --generate <games> <archive.rpa>
+// Archives (ReplayArchiveHeader, then size-prefixed replays) and single
+// replay files can be mixed. Inputs are read front to back in bounded batches;
+// while one batch is re-simulated on the job system the next is read, so
+// memory stays at two batches however large the archive is. Every worker
+// fills its own accumulator and the accumulators are summed at the end.
+// --heatmap also saves where heads went and snakes died, for the overlay.
+// --generate writes an archive of bot games for testing.
+
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "game.h"
+#include "heatmap.h"
+#include "job_system.h"
+#include "replay.h"
+
+using namespace std;
+
+#define STATS_BATCH_BYTES (16 << 20)
+#define STATS_GAMES_PER_JOB 64
+#define STATS_MAX_REPLAY_BYTES (256u << 20)
+#define STATS_BUCKETS 256               // The last bucket also counts everything above it
+#define STATS_SCORE_BUCKET 10           // One food
+#define STATS_FIRST_FOOD_BUCKET 4       // Ticks
+#define STATS_DURATION_BUCKET 64        // Ticks
+
+// One per thread; aligned so two workers never write the same cache line
+struct alignas(64) StatsAccumulator{
+    uint64_t games;
+    uint64_t invalid;
+    uint64_t ticks;
+    uint64_t food;
+    uint64_t scoreSum;
+    uint64_t borderDeaths;
+    uint64_t selfDeaths;
+    uint64_t unfinished;
+    uint64_t neverAte;
+    int maxScore;
+    uint64_t scores[STATS_BUCKETS];
+    uint64_t firstFood[STATS_BUCKETS];
+    uint64_t durations[STATS_BUCKETS];
+    Heatmap heatmap;
+};
+
+// std::allocator ignores alignas before C++17, so the accumulators are
+// placed by hand at a 64-byte boundary inside an over-allocated buffer.
+// sizeof(StatsAccumulator) is a multiple of 64, so every one starts a line.
+struct AccumulatorArray{
+    vector<uint8_t> storage;
+    StatsAccumulator* items;    // Zeroed; slot 0 is any non-worker thread
+    size_t count;
+};
+
+static void allocateAccumulators(AccumulatorArray& array, size_t count) {
+    array.storage.assign(count * sizeof(StatsAccumulator) + alignof(StatsAccumulator) - 1, 0);
+    uintptr_t base = (uintptr_t)array.storage.data();
+    base = (base + alignof(StatsAccumulator) - 1) & ~(uintptr_t)(alignof(StatsAccumulator) - 1);
+    array.items = (StatsAccumulator*)base;
+    array.count = count;
+}
+
+struct StatsBatch;
+
+struct StatsJob{
+    const StatsBatch* batch;
+    size_t first, last;                 // Replay indices
+    JobSystem* system;
+    StatsAccumulator* accumulators;     // Slot 0 is any non-worker thread
+};
+
+struct StatsBatch{
+    vector<uint8_t> bytes;
+    vector<size_t> offsets;     // Start of each replay in bytes, plus the end
+    vector<StatsJob> work;
+    vector<Job> jobs;
+    JobGroup group;
+};
+
+// The inputs as one sequential stream of replays
+struct ReplayStream{
+    vector<string> paths;
+    size_t nextPath;
+    ifstream file;
+    bool archive;           // Otherwise the open file is a single replay
+    uint64_t bytesRead;
+};
+
+static void addToBucket(uint64_t* histogram, uint64_t value, uint64_t width) {
+    histogram[min(value / width, (uint64_t)STATS_BUCKETS - 1)]++;
+}
+
+static void analyzeReplay(const uint8_t* data, size_t size, StatsAccumulator& stats) {
+    Replay replay;
+    Game game;
+    ReplayCursor cursor;
+    if (!openReplayData(replay, data, size) || !seekReplay(replay, replay.header->startTick, game, cursor)) {
+        stats.invalid++;
+        return;
+    }
+
+    uint32_t startTick = game.tick;
+    int points = game.points;
+    bool ate = false;
+    while (stepReplay(replay, cursor, game)) {
+        addHeatmapVisit(stats.heatmap, game);
+        if (game.points != points) {
+            if (!ate) {
+                addToBucket(stats.firstFood, game.tick - startTick, STATS_FIRST_FOOD_BUCKET);
+                ate = true;
+            }
+            points = game.points;
+            stats.food++;
+        }
+    }
+
+    stats.games++;
+    stats.ticks += game.tick - startTick;
+    stats.scoreSum += (uint64_t)max(game.points, 0);
+    stats.maxScore = max(stats.maxScore, game.points);
+    addToBucket(stats.scores, (uint64_t)max(game.points, 0), STATS_SCORE_BUCKET);
+    addToBucket(stats.durations, game.tick - startTick, STATS_DURATION_BUCKET);
+    if (!ate) {
+        stats.neverAte++;
+    }
+    if (!game.over) {
+        stats.unfinished++;
+    } else {
+        addHeatmapDeath(stats.heatmap, game);
+        const SnakeSegment& head = game.snake.front();
+        bool border = head.x < 0 || head.x >= game.cols || head.y < 0 || head.y >= game.rows;
+        if (border) {
+            stats.borderDeaths++;
+        } else {
+            stats.selfDeaths++;
+        }
+    }
+}
+
+static void runStatsJob(void* data) {
+    StatsJob* job = (StatsJob*)data;
+    StatsAccumulator& stats = job->accumulators[currentJobWorker(job->system) + 1];
+    const StatsBatch& batch = *job->batch;
+    for (size_t i = job->first; i < job->last; ++i) {
+        analyzeReplay(batch.bytes.data() + batch.offsets[i], batch.offsets[i + 1] - batch.offsets[i], stats);
+    }
+}
+
+// Opens the next input; false once all have been read
+static bool openNextInput(ReplayStream& stream) {
+    while (stream.nextPath < stream.paths.size()) {
+        const string& path = stream.paths[stream.nextPath++];
+        stream.file.close();
+        stream.file.clear();
+        stream.file.open(path.c_str(), ios::binary);
+        char magic[4];
+        if (!stream.file || !stream.file.read(magic, 4)) {
+            cout << "Unable to read " << path << endl;
+            continue;
+        }
+        if (memcmp(magic, REPLAY_MAGIC, 4) == 0) {
+            stream.archive = false;
+            stream.file.seekg(0);
+            return true;
+        }
+        uint32_t version;
+        if (memcmp(magic, REPLAY_ARCHIVE_MAGIC, 4) == 0 && stream.file.read((char*)&version, 4) &&
+            version == REPLAY_ARCHIVE_VERSION) {
+            stream.archive = true;
+            stream.bytesRead += sizeof(ReplayArchiveHeader);
+            return true;
+        }
+        cout << "Skipping " << path << ": not a replay or replay archive" << endl;
+    }
+    stream.file.close();
+    return false;
+}
+
+// Appends the next replay to bytes; false at the end of every input
+static bool readReplay(ReplayStream& stream, vector<uint8_t>& bytes) {
+    while (stream.file.is_open() || openNextInput(stream)) {
+        size_t start = bytes.size();
+        if (stream.archive) {
+            uint32_t size;
+            if (stream.file.read((char*)&size, 4) && size <= STATS_MAX_REPLAY_BYTES) {
+                bytes.resize(start + size);
+                if (stream.file.read((char*)bytes.data() + start, size)) {
+                    stream.bytesRead += 4 + size;
+                    return true;
+                }
+            }
+            if (!stream.file.eof() || stream.file.gcount() != 0) {
+                cout << "Archive " << stream.paths[stream.nextPath - 1] << " is truncated or damaged" << endl;
+            }
+        } else {
+            vector<char> contents((istreambuf_iterator<char>(stream.file)), istreambuf_iterator<char>());
+            bytes.insert(bytes.end(), contents.begin(), contents.end());
+            stream.bytesRead += contents.size();
+            stream.file.close();
+            return true;
+        }
+        bytes.resize(start);
+        stream.file.close();
+    }
+    return false;
+}
+
+// Reads up to STATS_BATCH_BYTES of replays; false if there were none left
+static bool fillBatch(ReplayStream& stream, StatsBatch& batch) {
+    batch.bytes.clear();
+    batch.offsets.assign(1, 0);
+    while (batch.bytes.size() < STATS_BATCH_BYTES && readReplay(stream, batch.bytes)) {
+        batch.offsets.push_back(batch.bytes.size());
+    }
+    return batch.offsets.size() > 1;
+}
+
+static void submitBatch(JobSystem* system, StatsBatch& batch, AccumulatorArray& accumulators) {
+    size_t games = batch.offsets.size() - 1;
+    size_t jobCount = (games + STATS_GAMES_PER_JOB - 1) / STATS_GAMES_PER_JOB;
+    batch.work.resize(jobCount);
+    batch.jobs.resize(jobCount);
+    for (size_t i = 0; i < jobCount; ++i) {
+        batch.work[i].batch = &batch;
+        batch.work[i].first = i * STATS_GAMES_PER_JOB;
+        batch.work[i].last = min(games, (i + 1) * STATS_GAMES_PER_JOB);
+        batch.work[i].system = system;
+        batch.work[i].accumulators = accumulators.items;
+        batch.jobs[i].function = runStatsJob;
+        batch.jobs[i].data = &batch.work[i];
+        batch.jobs[i].group = &batch.group;
+        submitJob(system, &batch.jobs[i]);
+    }
+}
+
+static void mergeStats(StatsAccumulator& total, const StatsAccumulator& part) {
+    total.games += part.games;
+    total.invalid += part.invalid;
+    total.ticks += part.ticks;
+    total.food += part.food;
+    total.scoreSum += part.scoreSum;
+    total.borderDeaths += part.borderDeaths;
+    total.selfDeaths += part.selfDeaths;
+    total.unfinished += part.unfinished;
+    total.neverAte += part.neverAte;
+    total.maxScore = max(total.maxScore, part.maxScore);
+    for (int i = 0; i < STATS_BUCKETS; ++i) {
+        total.scores[i] += part.scores[i];
+        total.firstFood[i] += part.firstFood[i];
+        total.durations[i] += part.durations[i];
+    }
+    mergeHeatmap(total.heatmap, part.heatmap);
+}
+
+// Lower edge of the bucket holding the q-th fraction of the samples
+static uint64_t percentile(const uint64_t* histogram, uint64_t width, double q) {
+    uint64_t count = 0;
+    for (int i = 0; i < STATS_BUCKETS; ++i) {
+        count += histogram[i];
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < STATS_BUCKETS; ++i) {
+        seen += histogram[i];
+        if (count > 0 && seen >= q * count) {
+            return i * width;
+        }
+    }
+    return 0;
+}
+
+static void printStats(const StatsAccumulator& stats) {
+    double games = (double)max(stats.games, (uint64_t)1);
+    double deaths = (double)max(stats.borderDeaths + stats.selfDeaths, (uint64_t)1);
+    cout << "  score: mean " << stats.scoreSum / games << ", max " << stats.maxScore
+         << ", p50 " << percentile(stats.scores, STATS_SCORE_BUCKET, 0.5)
+         << ", p90 " << percentile(stats.scores, STATS_SCORE_BUCKET, 0.9)
+         << ", p99 " << percentile(stats.scores, STATS_SCORE_BUCKET, 0.99) << endl;
+    cout << "  duration: mean " << stats.ticks / games << " ticks"
+         << ", p50 " << percentile(stats.durations, STATS_DURATION_BUCKET, 0.5)
+         << ", p90 " << percentile(stats.durations, STATS_DURATION_BUCKET, 0.9)
+         << ", p99 " << percentile(stats.durations, STATS_DURATION_BUCKET, 0.99) << endl;
+    cout << "  deaths: border " << stats.borderDeaths << " (" << 100.0 * stats.borderDeaths / deaths << "%)"
+         << ", self " << stats.selfDeaths << " (" << 100.0 * stats.selfDeaths / deaths << "%)"
+         << ", unfinished " << stats.unfinished << endl;
+    cout << "  first food: p50 " << percentile(stats.firstFood, STATS_FIRST_FOOD_BUCKET, 0.5) << " ticks"
+         << ", p90 " << percentile(stats.firstFood, STATS_FIRST_FOOD_BUCKET, 0.9) << " ticks"
+         << ", never ate " << stats.neverAte << ", food per game " << stats.food / games << endl;
+}
+
+static bool blocked(const Game& game, int x, int y) {
+    if (x < 0 || x >= game.cols || y < 0 || y >= game.rows) {
+        return true;
+    }
+    for (size_t i = 0; i + 1 < game.snake.size(); ++i) {
+        if (game.snake[i].x == x && game.snake[i].y == y) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Heads for the food, avoiding walls and its own body, and sometimes
+// turns at random so the archive has a spread of scores and deaths
+static char botDirection(const Game& game, uint32_t& rng) {
+    static const char directions[4] = { 'U', 'D', 'L', 'R' };
+    static const int dx[4] = { 0, 0, -1, 1 };
+    static const int dy[4] = { -1, 1, 0, 0 };
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    const SnakeSegment& head = game.snake.front();
+    if (rng % 20 == 0) {
+        return directions[(rng >> 8) % 4];
+    }
+    char fallback = game.direction;
+    for (int i = 0; i < 4; ++i) {
+        int x = head.x + dx[i];
+        int y = head.y + dy[i];
+        if (blocked(game, x, y)) {
+            continue;
+        }
+        fallback = directions[i];
+        if (abs(game.food.x - x) + abs(game.food.y - y) < abs(game.food.x - head.x) + abs(game.food.y - head.y)) {
+            return directions[i];
+        }
+    }
+    return fallback;
+}
+
+static int generateArchive(int games, const char* path) {
+    ofstream output(path, ios::binary | ios::trunc);
+    if (!output) {
+        cout << "Unable to write " << path << endl;
+        return 1;
+    }
+    ReplayArchiveHeader header;
+    memcpy(header.magic, REPLAY_ARCHIVE_MAGIC, 4);
+    header.version = REPLAY_ARCHIVE_VERSION;
+    output.write((const char*)&header, sizeof(header));
+
+    uint32_t rng = 2463534242u;
+    ReplayRecorder recorder;
+    for (int i = 0; i < games; ++i) {
+        Game game;
+        initGame(game, 54, 34, 3, (uint32_t)i * 2654435761u + 1);
+        startReplayRecording(recorder, game, REPLAY_KEYFRAME_INTERVAL);
+        while (!game.over && game.tick < 20000) {
+            setGameDirection(game, botDirection(game, rng));
+            recordReplayStep(recorder, game);
+            stepGame(game);
+        }
+        string replay = finishReplay(recorder, game.tick);
+        uint32_t size = (uint32_t)replay.size();
+        output.write((const char*)&size, 4);
+        output.write(replay.data(), replay.size());
+    }
+    if (!output) {
+        cout << "Failed writing " << path << endl;
+        return 1;
+    }
+    cout << "Wrote " << games << " replays to " << path << endl;
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc == 4 && string(argv[1]) == "--generate") {
+        return generateArchive(atoi(argv[2]), argv[3]);
+    }
+
+    int workers = defaultJobWorkerCount();
+    string heatmapPath;
+    ReplayStream stream;
+    stream.nextPath = 0;
+    stream.archive = false;
+    stream.bytesRead = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (string(argv[i]) == "--threads" && i + 1 < argc) {
+            workers = max(atoi(argv[++i]) - 1, 0);
+        } else if (string(argv[i]) == "--heatmap" && i + 1 < argc) {
+            heatmapPath = argv[++i];
+        } else {
+            stream.paths.push_back(argv[i]);
+        }
+    }
+    if (stream.paths.empty()) {
+        cout << "Usage: " << argv[0] << " [--threads N] [--heatmap out.hmp] <archive.rpa | replay.rpl>..." << endl;
+        cout << "       " << argv[0] << " --generate <games> <archive.rpa>" << endl;
+        return 1;
+    }
+
+    JobSystem* system = createJobSystem(workers);
+    if (system == NULL) {
+        return 1;
+    }
+    AccumulatorArray accumulators;
+    allocateAccumulators(accumulators, jobWorkerCount(system) + 1);
+
+    // Read batch n + 1 while batch n is being simulated
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    StatsBatch batches[2];
+    int current = 0;
+    bool inFlight = false;
+    while (fillBatch(stream, batches[current])) {
+        submitBatch(system, batches[current], accumulators);
+        if (inFlight) {
+            waitForJobGroup(system, batches[1 - current].group);
+        }
+        inFlight = true;
+        current = 1 - current;
+    }
+    if (inFlight) {
+        waitForJobGroup(system, batches[1 - current].group);
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    destroyJobSystem(system);
+
+    StatsAccumulator total = accumulators.items[0];
+    for (size_t i = 1; i < accumulators.count; ++i) {
+        mergeStats(total, accumulators.items[i]);
+    }
+    cout << "Replay stats: " << total.games << " games (" << total.invalid << " invalid), "
+         << stream.bytesRead / 1048576.0 << " MB in " << seconds << " s with " << accumulators.count << " thread(s)" << endl;
+    cout << "  throughput: " << total.games / max(seconds, 1e-9) << " games/s, "
+         << total.ticks / max(seconds, 1e-9) / 1e6 << " M ticks/s, "
+         << stream.bytesRead / 1048576.0 / max(seconds, 1e-9) << " MB/s" << endl;
+    printStats(total);
+
+    if (!heatmapPath.empty()) {
+        string data = saveHeatmap(total.heatmap);
+        ofstream output(heatmapPath.c_str(), ios::binary | ios::trunc);
+        if (!output.write(data.data(), data.size())) {
+            cout << "Unable to write " << heatmapPath << endl;
+            return 1;
+        }
+        cout << "Heatmap written to " << heatmapPath << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,109 @@
+#include "rewind.h"
+
+#include <algorithm>
+
+using namespace std;
+
+static void addKeyframe(RewindBuffer& buffer, const Game& game) {
+    RewindKeyframe keyframe;
+    keyframe.tick = game.tick;
+    snapshotGame(game, keyframe.snapshot);
+    buffer.keyframes.push_back(keyframe);
+}
+
+void resetRewind(RewindBuffer& buffer, const Game& game, int capacityTicks, int keyframeInterval) {
+    buffer.capacityTicks = max(capacityTicks, 1);
+    buffer.keyframeInterval = max(keyframeInterval, 1);
+    buffer.keyframes.clear();
+    buffer.deltas.clear();
+    addKeyframe(buffer, game);
+    buffer.lastLength = game.snake.size();
+}
+
+void recordRewindTick(RewindBuffer& buffer, const Game& game) {
+    RewindDelta delta;
+    delta.head = game.snake.front();
+    delta.food = game.food;
+    delta.points = game.points;
+    delta.rng = game.rng;
+    delta.direction = game.direction;
+    delta.grow = game.grow;
+    delta.over = game.over;
+    delta.tailRemoved = game.snake.size() == buffer.lastLength;
+    buffer.deltas.push_back(delta);
+    buffer.lastLength = game.snake.size();
+
+    if (game.tick - buffer.keyframes.back().tick >= (uint32_t)buffer.keyframeInterval) {
+        addKeyframe(buffer, game);
+    }
+
+    // Drop the oldest keyframe span once the next keyframe alone covers capacity
+    while (buffer.keyframes.size() > 1 &&
+           game.tick - buffer.keyframes[1].tick >= (uint32_t)buffer.capacityTicks) {
+        uint32_t span = buffer.keyframes[1].tick - buffer.keyframes[0].tick;
+        buffer.deltas.erase(buffer.deltas.begin(), buffer.deltas.begin() + span);
+        buffer.keyframes.pop_front();
+    }
+}
+
+uint32_t oldestRewindTick(const RewindBuffer& buffer) {
+    return buffer.keyframes.front().tick;
+}
+
+uint32_t newestRewindTick(const RewindBuffer& buffer) {
+    return buffer.keyframes.front().tick + (uint32_t)buffer.deltas.size();
+}
+
+bool rewindTo(const RewindBuffer& buffer, uint32_t tick, Game& game) {
+    if (buffer.keyframes.empty() || tick < oldestRewindTick(buffer) || tick > newestRewindTick(buffer)) {
+        return false;
+    }
+    // Newest keyframe at or before tick
+    size_t k = buffer.keyframes.size() - 1;
+    while (buffer.keyframes[k].tick > tick) {
+        --k;
+    }
+    const RewindKeyframe& keyframe = buffer.keyframes[k];
+    if (!restoreGame(game, keyframe.snapshot.data(), keyframe.snapshot.size())) {
+        return false;
+    }
+
+    size_t first = keyframe.tick - oldestRewindTick(buffer);
+    for (size_t i = first; i < first + (tick - keyframe.tick); ++i) {
+        const RewindDelta& delta = buffer.deltas[i];
+        game.snake.push_front(delta.head);
+        if (delta.tailRemoved) {
+            game.snake.pop_back();
+        }
+        game.food = delta.food;
+        game.points = delta.points;
+        game.rng = delta.rng;
+        game.direction = delta.direction;
+        game.grow = delta.grow;
+        game.over = delta.over;
+        game.tick++;
+    }
+    return true;
+}
+
+void truncateRewind(RewindBuffer& buffer, uint32_t tick) {
+    if (buffer.keyframes.empty() || tick < oldestRewindTick(buffer) || tick >= newestRewindTick(buffer)) {
+        return;
+    }
+    while (buffer.keyframes.back().tick > tick) {
+        buffer.keyframes.pop_back();
+    }
+    buffer.deltas.resize(tick - oldestRewindTick(buffer));
+
+    Game game;
+    rewindTo(buffer, tick, game);
+    buffer.lastLength = game.snake.size();
+}
+
+size_t rewindMemory(const RewindBuffer& buffer) {
+    size_t bytes = buffer.deltas.size() * sizeof(RewindDelta);
+    for (size_t i = 0; i < buffer.keyframes.size(); ++i) {
+        bytes += sizeof(RewindKeyframe) + buffer.keyframes[i].snapshot.capacity();
+    }
+    return bytes;
+}
@@ -0,0 +1,57 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "game.h"
+
+// The last few seconds of a classic game, for rewinding and for looking at
+// how a snake died. Every tick is kept as a small forward delta (new head,
+// whether the tail moved, and the scalar state after the tick), with a full
+// snapshot every keyframeInterval ticks. Reaching a tick restores the
+// keyframe at or before it and replays at most keyframeInterval deltas.
+// Ticks older than capacityTicks are dropped a keyframe span at a time, so
+// memory stays bounded however long the game runs.
+
+struct RewindDelta{
+    SnakeSegment head;      // Pushed to the front of the snake
+    Food food;
+    int points;
+    uint32_t rng;
+    char direction;
+    bool grow;
+    bool over;
+    bool tailRemoved;       // The last segment was popped
+};
+
+struct RewindKeyframe{
+    uint32_t tick;
+    std::vector<uint8_t> snapshot;  // snapshotGame blob
+};
+
+struct RewindBuffer{
+    int capacityTicks;
+    int keyframeInterval;
+    std::deque<RewindKeyframe> keyframes;   // Oldest first; the first one starts deltas
+    std::deque<RewindDelta> deltas;         // deltas[i] leads from keyframes.front().tick + i
+    size_t lastLength;                      // Snake length at the newest tick
+};
+
+// Forgets everything and starts over from the current state of game
+void resetRewind(RewindBuffer& buffer, const Game& game, int capacityTicks, int keyframeInterval);
+// Records the tick stepGame just produced
+void recordRewindTick(RewindBuffer& buffer, const Game& game);
+
+uint32_t oldestRewindTick(const RewindBuffer& buffer);
+uint32_t newestRewindTick(const RewindBuffer& buffer);
+// Rebuilds game as it was right after tick; false if the tick is not held
+bool rewindTo(const RewindBuffer& buffer, uint32_t tick, Game& game);
+// Drops every tick after tick, so play can carry on from there
+void truncateRewind(RewindBuffer& buffer, uint32_t tick);
+// Bytes held by keyframes and deltas
+size_t rewindMemory(const RewindBuffer& buffer);
+
+#endif
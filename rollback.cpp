@@ -0,0 +1,336 @@
+#include "rollback.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+void startRollback(RollbackSession& session, int localPlayer, const RollbackTransport& transport,
+                   int cols, int rows, uint32_t seed) {
+    session.localPlayer = localPlayer;
+    session.transport = transport;
+    initVersus(session.game, cols, rows, seed);
+    memset(session.inputs, 0, sizeof(session.inputs));
+    session.remoteConfirmed = 0;
+    session.localAcked = 0;
+    session.checkedTick = 0;
+    session.checksums.clear();
+    session.rollbacks = 0;
+    session.resimulatedTicks = 0;
+    session.longestRollback = 0;
+    session.stalls = 0;
+    session.worstRollbackMs = 0;
+}
+
+// The newest state no late input can change any more
+static const VersusGame& confirmedState(const RollbackSession& session) {
+    uint32_t tick = min(session.remoteConfirmed, session.game.tick);
+    return tick == session.game.tick ? session.game : session.saved[tick % ROLLBACK_WINDOW];
+}
+
+static void sendInputs(RollbackSession& session) {
+    uint8_t packet[ROLLBACK_MAX_PACKET];
+    uint32_t first = session.localAcked;
+    uint8_t count = (uint8_t)(session.game.tick - first);
+    memcpy(packet, &first, 4);
+    packet[4] = count;
+    for (uint32_t i = 0; i < count; ++i) {
+        packet[5 + i] = (uint8_t)session.inputs[session.localPlayer][(first + i) % ROLLBACK_WINDOW];
+    }
+    memcpy(packet + 5 + count, &session.remoteConfirmed, 4);
+    session.transport.send(session.transport.context, packet, 9 + count);
+}
+
+// Stores peer inputs in tick order; returns the first played tick that was mispredicted, or game.tick
+static uint32_t receiveInputs(RollbackSession& session) {
+    int remote = 1 - session.localPlayer;
+    uint32_t mispredicted = session.game.tick;
+    uint8_t packet[ROLLBACK_MAX_PACKET];
+    size_t size;
+    while ((size = session.transport.receive(session.transport.context, packet, sizeof(packet))) > 0) {
+        if (size < 9 || size != 9u + packet[4]) {
+            continue;
+        }
+        uint32_t first, ack;
+        memcpy(&first, packet, 4);
+        uint8_t count = packet[4];
+        memcpy(&ack, packet + 5 + count, 4);
+        session.localAcked = max(session.localAcked, min(ack, session.game.tick));
+
+        // Only the next missing tick is taken, so a reordered packet never leaves a gap
+        for (uint32_t i = 0; i < count; ++i) {
+            uint32_t tick = first + i;
+            if (tick != session.remoteConfirmed) {
+                continue;
+            }
+            char input = (char)packet[5 + i];
+            char& slot = session.inputs[remote][tick % ROLLBACK_WINDOW];
+            if (tick < session.game.tick && slot != input) {
+                mispredicted = min(mispredicted, tick);
+            }
+            slot = input;
+            session.remoteConfirmed++;
+        }
+    }
+    return mispredicted;
+}
+
+static void rollBack(RollbackSession& session, uint32_t from) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    uint32_t present = session.game.tick;
+    session.game = session.saved[from % ROLLBACK_WINDOW];
+    for (uint32_t tick = from; tick < present; ++tick) {
+        int slot = tick % ROLLBACK_WINDOW;
+        session.saved[slot] = session.game;
+        char inputs[VERSUS_PLAYERS] = { session.inputs[0][slot], session.inputs[1][slot] };
+        stepVersus(session.game, inputs);
+    }
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    session.rollbacks++;
+    session.resimulatedTicks += present - from;
+    session.longestRollback = max(session.longestRollback, present - from);
+    session.worstRollbackMs = max(session.worstRollbackMs, ms);
+}
+
+static void recordChecksums(RollbackSession& session) {
+    uint32_t confirmed = min(session.remoteConfirmed, session.game.tick);
+    uint32_t tick = (session.checkedTick / ROLLBACK_CHECKSUM_INTERVAL + 1) * ROLLBACK_CHECKSUM_INTERVAL;
+    for (; tick <= confirmed; tick += ROLLBACK_CHECKSUM_INTERVAL) {
+        const VersusGame& state = tick == session.game.tick ? session.game : session.saved[tick % ROLLBACK_WINDOW];
+        session.checksums.push_back(versusChecksum(state));
+    }
+    session.checkedTick = max(session.checkedTick, confirmed);
+}
+
+bool advanceRollback(RollbackSession& session, char localInput) {
+    uint32_t mispredicted = receiveInputs(session);
+    if (mispredicted < session.game.tick) {
+        rollBack(session, mispredicted);
+    }
+    recordChecksums(session);
+
+    // Too far ahead: the oldest state a late input could need would be overwritten.
+    // The peer may be ahead of us instead, so remoteConfirmed can exceed the tick.
+    uint32_t tick = session.game.tick;
+    if (tick >= session.remoteConfirmed + ROLLBACK_WINDOW - 1 || tick >= session.localAcked + ROLLBACK_WINDOW - 1) {
+        session.stalls++;
+        sendInputs(session);
+        return false;
+    }
+
+    int slot = tick % ROLLBACK_WINDOW;
+    int remote = 1 - session.localPlayer;
+    session.saved[slot] = session.game;
+    session.inputs[session.localPlayer][slot] = localInput;
+    if (tick >= session.remoteConfirmed) {
+        session.inputs[remote][slot] = 0;   // Predict that the peer keeps going
+    }
+    char inputs[VERSUS_PLAYERS] = { session.inputs[0][slot], session.inputs[1][slot] };
+    stepVersus(session.game, inputs);
+    sendInputs(session);
+    return true;
+}
+
+bool rollbackMatchOver(const RollbackSession& session) {
+    return versusOver(confirmedState(session));
+}
+
+static uint32_t nextLinkRandom(LoopbackLink& link) {
+    link.rng ^= link.rng << 13;
+    link.rng ^= link.rng >> 17;
+    link.rng ^= link.rng << 5;
+    return link.rng;
+}
+
+void initLoopback(LoopbackLink& link, double latencyMs, double jitterMs, int lossPercent, uint32_t seed) {
+    for (int p = 0; p < VERSUS_PLAYERS; ++p) {
+        link.inFlight[p].clear();
+    }
+    link.now = 0;
+    link.latencyMs = max(0.0, latencyMs);
+    link.jitterMs = max(0.0, jitterMs);
+    link.lossPercent = min(100, max(0, lossPercent));
+    link.rng = seed != 0 ? seed : 0x2545F491u;
+    link.sent = 0;
+    link.lost = 0;
+}
+
+static void loopbackSend(void* context, const uint8_t* data, size_t size) {
+    LoopbackEnd* end = (LoopbackEnd*)context;
+    LoopbackLink& link = *end->link;
+    link.sent++;
+    if ((int)(nextLinkRandom(link) % 100) < link.lossPercent) {
+        link.lost++;
+        return;
+    }
+    LoopbackPacket packet;
+    packet.deliverAt = link.now + link.latencyMs + link.jitterMs * (nextLinkRandom(link) % 1000) / 1000.0;
+    packet.data.assign(data, data + size);
+    link.inFlight[1 - end->player].push_back(packet);
+}
+
+// Jitter lets a later packet overtake an earlier one, as on a real network
+static size_t loopbackReceive(void* context, uint8_t* data, size_t capacity) {
+    LoopbackEnd* end = (LoopbackEnd*)context;
+    LoopbackLink& link = *end->link;
+    deque<LoopbackPacket>& queue = link.inFlight[end->player];
+    deque<LoopbackPacket>::iterator next = queue.end();
+    for (deque<LoopbackPacket>::iterator it = queue.begin(); it != queue.end(); ++it) {
+        if (it->deliverAt <= link.now && (next == queue.end() || it->deliverAt < next->deliverAt)) {
+            next = it;
+        }
+    }
+    if (next == queue.end()) {
+        return 0;
+    }
+    size_t size = min(capacity, next->data.size());
+    memcpy(data, next->data.data(), size);
+    queue.erase(next);
+    return size;
+}
+
+RollbackTransport loopbackTransport(LoopbackEnd& end) {
+    RollbackTransport transport;
+    transport.send = loopbackSend;
+    transport.receive = loopbackReceive;
+    transport.context = &end;
+    return transport;
+}
+
+static bool freeCell(const VersusGame& game, int x, int y) {
+    if (x < 0 || x >= game.cols || y < 0 || y >= game.rows) {
+        return false;
+    }
+    for (int p = 0; p < VERSUS_PLAYERS; ++p) {
+        for (int i = 0; i < game.length[p]; ++i) {
+            if (versusSegment(game, p, i) == y * game.cols + x) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Turns now and then, and away from anything straight ahead
+static char benchmarkBot(const VersusGame& game, int player, uint32_t& rng) {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    static const char directions[4] = { 'U', 'R', 'D', 'L' };
+    static const int dx[4] = { 0, 1, 0, -1 };
+    static const int dy[4] = { -1, 0, 1, 0 };
+    int current = 0;
+    while (current < 3 && directions[current] != game.direction[player]) {
+        current++;
+    }
+    int cell = versusSegment(game, player, 0);
+    int x = cell % game.cols, y = cell / game.cols;
+    int first = rng % 10 == 0 ? current + ((rng >> 8) % 2 == 0 ? 1 : 3) : current;
+    for (int turn = 0; turn < 4; ++turn) {
+        int d = (first + (turn == 0 ? 0 : turn == 1 ? 1 : turn == 2 ? 3 : 2)) % 4;
+        if (freeCell(game, x + dx[d], y + dy[d])) {
+            return d == current ? 0 : directions[d];
+        }
+    }
+    return 0;
+}
+
+void runRollbackBenchmark(double latencyMs, int lossPercent) {
+    const int cols = 40, rows = 30;
+    const double frameMs = 1000.0 / 60;
+    LoopbackLink link;
+    initLoopback(link, latencyMs, latencyMs / 4, lossPercent, 7);
+    LoopbackEnd ends[VERSUS_PLAYERS] = { { &link, 0 }, { &link, 1 } };
+    vector<RollbackSession> sessions(VERSUS_PLAYERS);   // Large; kept off the stack
+    uint32_t seed = 1;
+    for (int p = 0; p < VERSUS_PLAYERS; ++p) {
+        startRollback(sessions[p], p, loopbackTransport(ends[p]), cols, rows, seed);
+    }
+    cout << "Rollback benchmark: " << cols << "x" << rows << " board, " << latencyMs << " ms latency, "
+         << lossPercent << "% loss, 60 ticks per second" << endl;
+
+    uint32_t botRng[VERSUS_PLAYERS] = { 12345, 67890 };
+    long long ticks = 0, rollbacks = 0, resimulated = 0, stalls = 0;
+    uint32_t longest = 0;
+    double worstMs = 0;
+    int matches = 0, compared = 0, desyncs = 0;
+    for (int frame = 0; frame < 36000; ++frame) {
+        link.now += frameMs;
+        for (int p = 0; p < VERSUS_PLAYERS; ++p) {
+            ticks += advanceRollback(sessions[p], benchmarkBot(sessions[p].game, p, botRng[p]));
+        }
+        if (!rollbackMatchOver(sessions[0]) || !rollbackMatchOver(sessions[1])) {
+            continue;
+        }
+
+        // Both peers must have seen the same confirmed states and the same ending
+        size_t common = min(sessions[0].checksums.size(), sessions[1].checksums.size());
+        for (size_t i = 0; i < common; ++i) {
+            desyncs += sessions[0].checksums[i] != sessions[1].checksums[i];
+        }
+        const VersusGame& end0 = confirmedState(sessions[0]);
+        const VersusGame& end1 = confirmedState(sessions[1]);
+        for (int p = 0; p < VERSUS_PLAYERS; ++p) {
+            desyncs += end0.points[p] != end1.points[p] || end0.alive[p] != end1.alive[p];
+        }
+        compared += (int)common + 1;
+        matches++;
+        for (int p = 0; p < VERSUS_PLAYERS; ++p) {
+            RollbackSession& session = sessions[p];
+            rollbacks += session.rollbacks;
+            resimulated += session.resimulatedTicks;
+            stalls += session.stalls;
+            longest = max(longest, session.longestRollback);
+            worstMs = max(worstMs, session.worstRollbackMs);
+        }
+        seed++;
+        for (int p = 0; p < VERSUS_PLAYERS; ++p) {
+            link.inFlight[p].clear();
+            startRollback(sessions[p], p, loopbackTransport(ends[p]), cols, rows, seed);
+        }
+    }
+    cout << "  " << matches << " matches, " << ticks << " ticks played, packets " << link.sent << " sent, "
+         << link.lost << " lost" << endl;
+    cout << "  " << rollbacks << " rollbacks, " << (rollbacks > 0 ? (double)resimulated / rollbacks : 0)
+         << " ticks average, " << longest << " longest, worst " << worstMs << " ms; " << stalls << " stalled frames" << endl;
+    cout << "  " << desyncs << " desyncs in " << compared << " confirmed states compared" << endl;
+
+    // Restore and re-simulate ten ticks from a busy board with long snakes
+    VersusGame base;
+    initVersus(base, cols, rows, 99);
+    uint32_t rng = 4242;
+    for (int tick = 0; tick < 400; ++tick) {
+        VersusGame next = base;
+        next.grow[0] = next.grow[1] = true;
+        char inputs[VERSUS_PLAYERS] = { benchmarkBot(next, 0, rng), benchmarkBot(next, 1, rng) };
+        stepVersus(next, inputs);
+        if (versusOver(next)) {
+            break;
+        }
+        base = next;
+    }
+    char planned[10][VERSUS_PLAYERS];
+    VersusGame probe = base;
+    for (int tick = 0; tick < 10; ++tick) {
+        planned[tick][0] = benchmarkBot(probe, 0, rng);
+        planned[tick][1] = benchmarkBot(probe, 1, rng);
+        stepVersus(probe, planned[tick]);
+    }
+    vector<VersusGame> saved(ROLLBACK_WINDOW);
+    const int repeats = 2000;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int r = 0; r < repeats; ++r) {
+        VersusGame game = base;
+        for (int tick = 0; tick < 10; ++tick) {
+            saved[tick] = game;
+            stepVersus(game, planned[tick]);
+        }
+        saved[10] = game;
+    }
+    double micros = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() / repeats;
+    cout << "  Rolling back 10 ticks with snakes of " << base.length[0] << " and " << base.length[1] << ": "
+         << micros << " us, against a " << frameMs << " ms frame" << endl;
+}
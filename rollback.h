@@ -0,0 +1,100 @@
+#ifndef ROLLBACK_H
+#define ROLLBACK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "versus.h"
+
+// Rollback netcode for versus, in the style of GGPO. Each peer plays its
+// own input at once and predicts that the other player keeps going
+// straight. When the real input for an already played tick arrives and
+// differs from the prediction, the session restores the state saved
+// before that tick and plays the ticks since again with what is now
+// known. Both peers step the same deterministic rules on the same
+// confirmed inputs, so they agree once the inputs have arrived.
+//
+// Every packet carries all local inputs the peer has not acknowledged
+// yet, so lost packets need no resends of their own. A session runs at
+// most ROLLBACK_WINDOW - 1 ticks ahead of what the peer has confirmed,
+// and stalls beyond that.
+//
+// Packet layout (little-endian): first tick (uint32_t), input count
+// (uint8_t), that many inputs, then the tick of the first peer input
+// still missing (uint32_t).
+
+#define ROLLBACK_WINDOW 32
+#define ROLLBACK_MAX_PACKET (4 + 1 + ROLLBACK_WINDOW + 4)
+#define ROLLBACK_CHECKSUM_INTERVAL 64
+
+// How a session reaches its peer; unreliable and unordered delivery of
+// whole packets is enough
+struct RollbackTransport{
+    void (*send)(void* context, const uint8_t* data, size_t size);
+    // Copies the next packet that has arrived into data; returns its size, or 0 when there is none
+    size_t (*receive)(void* context, uint8_t* data, size_t capacity);
+    void* context;
+};
+
+struct RollbackSession{
+    int localPlayer;
+    RollbackTransport transport;
+    VersusGame game;                                // The present, played on predictions
+    VersusGame saved[ROLLBACK_WINDOW];              // saved[t % ROLLBACK_WINDOW] is the state before tick t
+    char inputs[VERSUS_PLAYERS][ROLLBACK_WINDOW];   // The input tick t was (last) played with
+    uint32_t remoteConfirmed;                       // Peer inputs are known for every tick below this
+    uint32_t localAcked;                            // The peer has every local input below this
+    uint32_t checkedTick;                           // Last tick whose state went into checksums
+    std::vector<uint32_t> checksums;                // Confirmed states every ROLLBACK_CHECKSUM_INTERVAL ticks
+
+    // Statistics
+    uint32_t rollbacks;
+    uint32_t resimulatedTicks;
+    uint32_t longestRollback;
+    uint32_t stalls;
+    double worstRollbackMs;
+};
+
+void startRollback(RollbackSession& session, int localPlayer, const RollbackTransport& transport,
+                   int cols, int rows, uint32_t seed);
+// Takes in the peer's packets, rolls back if a prediction was wrong, plays
+// one tick with the local input (a direction or 0) and sends. Returns false,
+// having played nothing, while the peer is too far behind.
+bool advanceRollback(RollbackSession& session, char localInput);
+// The game is over and no prediction could still change that
+bool rollbackMatchOver(const RollbackSession& session);
+
+// Loopback transport for testing on one machine: both ends in one process,
+// with artificial latency, jitter and loss. Time only moves when now is
+// set, so runs can be simulated faster than real time.
+struct LoopbackPacket{
+    double deliverAt;
+    std::vector<uint8_t> data;
+};
+
+struct LoopbackLink{
+    std::deque<LoopbackPacket> inFlight[VERSUS_PLAYERS];    // Towards each player
+    double now;                                             // Milliseconds
+    double latencyMs;
+    double jitterMs;
+    int lossPercent;
+    uint32_t rng;
+    uint32_t sent, lost;
+};
+
+struct LoopbackEnd{
+    LoopbackLink* link;
+    int player;
+};
+
+void initLoopback(LoopbackLink& link, double latencyMs, double jitterMs, int lossPercent, uint32_t seed);
+// The transport for one player's session; end must outlive it
+RollbackTransport loopbackTransport(LoopbackEnd& end);
+
+// Plays two sessions against each other over a loopback link and reports
+// rollbacks, desyncs and what re-simulating ten ticks costs
+void runRollbackBenchmark(double latencyMs, int lossPercent);
+
+#endif
@@ -0,0 +1,84 @@
+// Watches a game streamed with --stream and prints a line per keyframe:
+//     spectate_client [port]
+// Each keyframe is also checked against the state rebuilt from the deltas
+// before it, so the tool doubles as a test of the stream.
+
+#include <SDL2/SDL.h>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "game.h"
+#include "net_util.h"
+#include "spectator_stream.h"
+
+using namespace std;
+
+static bool sameSnake(const Game& a, const Game& b) {
+    if (a.snake.size() != b.snake.size() || a.food.x != b.food.x || a.food.y != b.food.y || a.points != b.points) {
+        return false;
+    }
+    for (size_t i = 0; i < a.snake.size(); ++i) {
+        if (a.snake[i].x != b.snake[i].x || a.snake[i].y != b.snake[i].y) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    int port = argc > 1 ? atoi(argv[1]) : SPECTATOR_PORT;
+    if (!initNetwork()) {
+        return 1;
+    }
+    SocketHandle socket = connectLocal(port);
+    if (socket == NO_SOCKET) {
+        cout << "Nothing is streaming on 127.0.0.1:" << port << endl;
+        return 1;
+    }
+
+    Game game, keyframe;
+    bool haveKeyframe = false;
+    long long messages = 0, bytes = 0, mismatches = 0;
+    vector<uint8_t> buffer;
+    size_t consumed = 0;
+    char chunk[4096];
+    long received;
+    while ((received = receiveSocket(socket, chunk, sizeof(chunk))) >= 0) {
+        buffer.insert(buffer.end(), chunk, chunk + received);
+        bytes += received;
+        while (buffer.size() - consumed >= 4) {
+            uint32_t size;
+            memcpy(&size, &buffer[consumed], 4);
+            if (buffer.size() - consumed - 4 < size) {
+                break;
+            }
+            const uint8_t* message = &buffer[consumed + 4];
+            // Periodic keyframes follow the delta for the same tick; others mark a jump
+            if (size > 0 && message[0] == SPECTATOR_KEYFRAME && haveKeyframe) {
+                bool valid = false;
+                if (applySpectatorMessage(keyframe, valid, message, size) && keyframe.tick == game.tick &&
+                    !sameSnake(game, keyframe)) {
+                    mismatches++;
+                }
+            }
+            if (!applySpectatorMessage(game, haveKeyframe, message, size)) {
+                cout << "Bad message of " << size << " bytes" << endl;
+            }
+            if (size > 0 && message[0] == SPECTATOR_KEYFRAME) {
+                cout << "tick " << game.tick << "  length " << game.snake.size() << "  score " << game.points
+                     << (game.over ? "  game over" : "") << "  (" << messages << " messages, " << bytes
+                     << " bytes, " << mismatches << " mismatches)" << endl;
+            }
+            messages++;
+            consumed += 4 + size;
+        }
+        buffer.erase(buffer.begin(), buffer.begin() + consumed);
+        consumed = 0;
+    }
+    closeSocket(socket);
+    cout << "Stream ended after " << messages << " messages, " << mismatches << " mismatches" << endl;
+    return 0;
+}
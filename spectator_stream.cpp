@@ -0,0 +1,364 @@
+#include "spectator_stream.h"
+
+#include <SDL2/SDL_mutex.h>
+#include <SDL2/SDL_thread.h>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "net_util.h"
+
+using namespace std;
+
+struct SpectatorClient{
+    SocketHandle socket;
+    string queue;
+    size_t sent;                // Bytes of queue already sent
+};
+
+struct SpectatorServer{
+    SocketHandle listener;
+    SocketHandle wake[2];       // A byte into wake[0] wakes the network thread, which waits on wake[1]
+    SDL_Thread* thread;
+    SDL_mutex* lock;
+
+    // Guarded by lock
+    bool stopping;
+    bool wakePending;           // A wake byte is on its way, so more publishes need not send one
+    string outgoing;            // Published since the network thread last looked
+    string sinceKeyframe;       // The last keyframe and every delta after it, for new spectators
+
+    // Network thread only
+    vector<SpectatorClient> clients;
+
+    // Game thread only: what spectators were last told
+    bool published;
+    SnakeSegment head;
+    size_t length;
+    Food food;
+    int points;
+    uint32_t keyframeTick;
+    vector<uint8_t> snapshot;
+    string message;
+};
+
+template <typename T>
+static void appendRaw(string& out, const T& value) {
+    out.append((const char*)&value, sizeof(value));
+}
+
+static void beginMessage(string& message, uint8_t type) {
+    message.assign(4, '\0');
+    message.push_back((char)type);
+}
+
+static void finishMessage(string& message) {
+    uint32_t size = (uint32_t)message.size() - 4;
+    memcpy(&message[0], &size, 4);
+}
+
+// Call with lock held, after queueing something for the network thread
+static void wakeNetworkThread(SpectatorServer* server) {
+    if (!server->wakePending) {
+        server->wakePending = true;
+        char byte = 0;
+        sendSocket(server->wake[0], &byte, 1);
+    }
+}
+
+static void rememberPublished(SpectatorServer* server, const Game& game) {
+    server->published = true;
+    server->head = game.snake.front();
+    server->length = game.snake.size();
+    server->food = game.food;
+    server->points = game.points;
+}
+
+void publishSpectatorKeyframe(SpectatorServer* server, const Game& game) {
+    if (server == NULL) {
+        return;
+    }
+    snapshotGame(game, server->snapshot);
+    beginMessage(server->message, SPECTATOR_KEYFRAME);
+    server->message.append((const char*)server->snapshot.data(), server->snapshot.size());
+    finishMessage(server->message);
+
+    SDL_LockMutex(server->lock);
+    server->outgoing += server->message;
+    server->sinceKeyframe = server->message;
+    wakeNetworkThread(server);
+    SDL_UnlockMutex(server->lock);
+
+    rememberPublished(server, game);
+    server->keyframeTick = game.tick;
+}
+
+void publishSpectatorTick(SpectatorServer* server, const Game& game) {
+    if (server == NULL) {
+        return;
+    }
+    if (!server->published) {
+        publishSpectatorKeyframe(server, game);
+        return;
+    }
+
+    const SnakeSegment& head = game.snake.front();
+    bool headAdded = head.x != server->head.x || head.y != server->head.y;
+    bool tailRemoved = server->length + (headAdded ? 1 : 0) > game.snake.size();
+    uint8_t flags = (headAdded ? SPECTATOR_HEAD_ADDED : 0) | (tailRemoved ? SPECTATOR_TAIL_REMOVED : 0);
+    if (game.food.x != server->food.x || game.food.y != server->food.y) {
+        flags |= SPECTATOR_FOOD_MOVED;
+    }
+    if (game.points != server->points) {
+        flags |= SPECTATOR_SCORE_CHANGED;
+    }
+    if (game.over) {
+        flags |= SPECTATOR_GAME_OVER;
+    }
+
+    beginMessage(server->message, SPECTATOR_DELTA);
+    appendRaw(server->message, game.tick);
+    appendRaw(server->message, flags);
+    if (headAdded) {
+        appendRaw(server->message, (int16_t)head.x);
+        appendRaw(server->message, (int16_t)head.y);
+    }
+    if (flags & SPECTATOR_FOOD_MOVED) {
+        appendRaw(server->message, (int16_t)game.food.x);
+        appendRaw(server->message, (int16_t)game.food.y);
+    }
+    if (flags & SPECTATOR_SCORE_CHANGED) {
+        appendRaw(server->message, (int32_t)game.points);
+    }
+    finishMessage(server->message);
+
+    SDL_LockMutex(server->lock);
+    server->outgoing += server->message;
+    server->sinceKeyframe += server->message;
+    wakeNetworkThread(server);
+    SDL_UnlockMutex(server->lock);
+
+    rememberPublished(server, game);
+    // After the delta, not instead of it, so clients can check their state against it
+    if (game.tick - server->keyframeTick >= SPECTATOR_KEYFRAME_TICKS) {
+        publishSpectatorKeyframe(server, game);
+    }
+}
+
+// Sends as much of the client's queue as the socket takes; false once it should be dropped
+static bool flushClient(SpectatorClient& client) {
+    while (client.sent < client.queue.size()) {
+        long sent = sendSocket(client.socket, client.queue.data() + client.sent, client.queue.size() - client.sent);
+        if (sent < 0) {
+            return false;
+        }
+        if (sent == 0) {
+            break;
+        }
+        client.sent += sent;
+    }
+    if (client.sent == client.queue.size()) {
+        client.queue.clear();
+        client.sent = 0;
+    } else if (client.sent > SPECTATOR_BACKLOG) {
+        client.queue.erase(0, client.sent);
+        client.sent = 0;
+    }
+    return client.queue.size() - client.sent <= SPECTATOR_BACKLOG;
+}
+
+static int spectatorMain(void* data) {
+    SpectatorServer& server = *(SpectatorServer*)data;
+    vector<SocketPoll> polls;
+    string batch, catchUp;
+    char discard[256];
+    // Sleeps until there is something to publish, a spectator to accept or
+    // hear from, or a backed-up spectator that can take more
+    while (true) {
+        polls.resize(server.clients.size() + 2);
+        polls[0].socket = server.listener;
+        polls[0].wantWrite = false;
+        polls[1].socket = server.wake[1];
+        polls[1].wantWrite = false;
+        for (size_t i = 0; i < server.clients.size(); ++i) {
+            polls[i + 2].socket = server.clients[i].socket;
+            polls[i + 2].wantWrite = server.clients[i].sent < server.clients[i].queue.size();
+        }
+        pollSockets(polls.data(), (int)polls.size(), -1);
+        if (polls[1].readable) {
+            while (receiveSocket(server.wake[1], discard, sizeof(discard)) > 0) {
+            }
+        }
+
+        // New spectators get the catch-up taken in the same lock as the batch,
+        // so they see every message exactly once
+        bool accepting = polls[0].readable;
+        SDL_LockMutex(server.lock);
+        bool stopping = server.stopping;
+        server.wakePending = false;
+        batch.clear();
+        batch.swap(server.outgoing);
+        if (accepting) {
+            catchUp = server.sinceKeyframe;
+        }
+        SDL_UnlockMutex(server.lock);
+        if (stopping) {
+            break;
+        }
+
+        for (size_t i = 0; i < server.clients.size(); ++i) {
+            SpectatorClient& client = server.clients[i];
+            client.queue += batch;
+            // Spectators have nothing to say; reading only notices when they leave
+            bool open = !polls[i + 2].readable || receiveSocket(client.socket, discard, sizeof(discard)) >= 0;
+            if (!open || !flushClient(client)) {
+                if (open) {
+                    cout << "Disconnected a spectator that stopped keeping up" << endl;
+                }
+                closeSocket(client.socket);
+                client.socket = NO_SOCKET;
+            }
+        }
+        for (size_t i = server.clients.size(); i-- > 0;) {
+            if (server.clients[i].socket == NO_SOCKET) {
+                server.clients[i] = server.clients.back();
+                server.clients.pop_back();
+            }
+        }
+
+        SocketHandle socket;
+        while (accepting && (socket = acceptSocket(server.listener)) != NO_SOCKET) {
+            if (server.clients.size() >= SPECTATOR_MAX_CLIENTS) {
+                closeSocket(socket);
+                continue;
+            }
+            SpectatorClient client = { socket, catchUp, 0 };
+            server.clients.push_back(client);
+            if (!flushClient(server.clients.back())) {
+                closeSocket(socket);
+                server.clients.pop_back();
+            }
+        }
+    }
+
+    for (SpectatorClient& client : server.clients) {
+        closeSocket(client.socket);
+    }
+    server.clients.clear();
+    return 0;
+}
+
+SpectatorServer* startSpectatorServer(int port) {
+    if (!initNetwork()) {
+        return NULL;
+    }
+    SocketHandle listener = listenLocal(port, 64);
+    if (listener == NO_SOCKET) {
+        return NULL;
+    }
+    SpectatorServer* server = new SpectatorServer();
+    server->listener = listener;
+    if (!socketPair(server->wake)) {
+        cout << "Unable to create the spectator wake-up sockets" << endl;
+        closeSocket(listener);
+        delete server;
+        return NULL;
+    }
+    server->stopping = false;
+    server->wakePending = false;
+    server->published = false;
+    server->keyframeTick = 0;
+    server->thread = NULL;
+    server->lock = SDL_CreateMutex();
+    if (server->lock != NULL) {
+        server->thread = SDL_CreateThread(spectatorMain, "spectators", server);
+    }
+    if (server->thread == NULL) {
+        cout << "Spectator thread creation failed: " << SDL_GetError() << endl;
+        if (server->lock != NULL) {
+            SDL_DestroyMutex(server->lock);
+        }
+        closeSocket(listener);
+        closeSocket(server->wake[0]);
+        closeSocket(server->wake[1]);
+        delete server;
+        return NULL;
+    }
+    cout << "Streaming to spectators on 127.0.0.1:" << port << endl;
+    return server;
+}
+
+void stopSpectatorServer(SpectatorServer* server) {
+    if (server == NULL) {
+        return;
+    }
+    SDL_LockMutex(server->lock);
+    server->stopping = true;
+    wakeNetworkThread(server);
+    SDL_UnlockMutex(server->lock);
+    SDL_WaitThread(server->thread, NULL);
+    SDL_DestroyMutex(server->lock);
+    closeSocket(server->listener);
+    closeSocket(server->wake[0]);
+    closeSocket(server->wake[1]);
+    delete server;
+}
+
+template <typename T>
+static bool readRaw(const uint8_t* data, size_t size, size_t& offset, T& value) {
+    if (size - offset < sizeof(T)) {
+        return false;
+    }
+    memcpy(&value, data + offset, sizeof(T));
+    offset += sizeof(T);
+    return true;
+}
+
+bool applySpectatorMessage(Game& game, bool& haveKeyframe, const uint8_t* message, size_t size) {
+    if (size == 0) {
+        return false;
+    }
+    if (message[0] == SPECTATOR_KEYFRAME) {
+        haveKeyframe = restoreGame(game, message + 1, size - 1);
+        return haveKeyframe;
+    }
+    if (message[0] != SPECTATOR_DELTA || !haveKeyframe) {
+        return false;
+    }
+
+    size_t offset = 1;
+    uint32_t tick;
+    uint8_t flags;
+    int16_t x, y;
+    if (!readRaw(message, size, offset, tick) || !readRaw(message, size, offset, flags)) {
+        return false;
+    }
+    if (flags & SPECTATOR_HEAD_ADDED) {
+        if (!readRaw(message, size, offset, x) || !readRaw(message, size, offset, y)) {
+            return false;
+        }
+        SnakeSegment head = { x, y };
+        game.snake.push_front(head);
+    }
+    if ((flags & SPECTATOR_TAIL_REMOVED) && game.snake.size() > 1) {
+        game.snake.pop_back();
+    }
+    if (flags & SPECTATOR_FOOD_MOVED) {
+        if (!readRaw(message, size, offset, x) || !readRaw(message, size, offset, y)) {
+            return false;
+        }
+        game.food.x = x;
+        game.food.y = y;
+    }
+    if (flags & SPECTATOR_SCORE_CHANGED) {
+        int32_t points;
+        if (!readRaw(message, size, offset, points)) {
+            return false;
+        }
+        game.points = points;
+    }
+    game.over = (flags & SPECTATOR_GAME_OVER) != 0;
+    game.tick = tick;
+    return offset == size;
+}
@@ -0,0 +1,60 @@
+#ifndef SPECTATOR_STREAM_H
+#define SPECTATOR_STREAM_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "game.h"
+
+// Publishes the classic game over localhost TCP so spectators and tools
+// can watch it live. Each tick sends only what changed: the new head,
+// whether the tail went, food, score and game over. A keyframe (the game
+// snapshot) follows the delta every SPECTATOR_KEYFRAME_TICKS and replaces
+// it whenever the game jumps. A spectator that connects mid-game is first
+// sent the last keyframe and every delta since.
+//
+// The game thread only encodes a few bytes and appends them under a lock.
+// A network thread accepts spectators and fans the stream out with
+// non-blocking sends; a spectator that falls SPECTATOR_BACKLOG bytes
+// behind is disconnected rather than slowing anyone else down.
+//
+// Stream layout (little-endian): messages of uint32_t size, then a type
+// byte and size - 1 bytes of payload.
+//   SPECTATOR_KEYFRAME  snapshotGame bytes
+//   SPECTATOR_DELTA     tick (uint32_t), flags (uint8_t), then as flagged:
+//                       head x, y (int16_t each), food x, y (int16_t each), points (int32_t)
+
+#define SPECTATOR_PORT 7531
+#define SPECTATOR_KEYFRAME_TICKS 70
+#define SPECTATOR_BACKLOG (256 * 1024)
+#define SPECTATOR_MAX_CLIENTS 256
+
+enum SpectatorMessageType{
+    SPECTATOR_KEYFRAME = 1,
+    SPECTATOR_DELTA = 2
+};
+
+enum SpectatorDeltaFlags{
+    SPECTATOR_HEAD_ADDED = 1,
+    SPECTATOR_TAIL_REMOVED = 2,
+    SPECTATOR_FOOD_MOVED = 4,
+    SPECTATOR_SCORE_CHANGED = 8,
+    SPECTATOR_GAME_OVER = 16
+};
+
+struct SpectatorServer;
+
+// Listens on 127.0.0.1:port; NULL (with the reason printed) if it cannot.
+// Every function below accepts NULL and does nothing with it.
+SpectatorServer* startSpectatorServer(int port);
+void stopSpectatorServer(SpectatorServer* server);
+// Call after every stepGame
+void publishSpectatorTick(SpectatorServer* server, const Game& game);
+// Call when the game changes other than by a step: a new game, a load, the end of a rewind
+void publishSpectatorKeyframe(SpectatorServer* server, const Game& game);
+
+// For clients: applies one message (type byte and payload) to game. False
+// if it is malformed or a delta comes before the first keyframe.
+bool applySpectatorMessage(Game& game, bool& haveKeyframe, const uint8_t* message, size_t size);
+
+#endif
@@ -4,10 +4,30 @@
 #include <SDL2/SDL_mixer.h>
 #include <fstream>
 #include <iostream>
+#include <iterator>
 #include <vector>
+#include <cmath>
+#include <cstdio>
 #include <cstdlib>
 #include <ctime>
 #include <string>
+#include <algorithm>
+
+#include "arena.h"
+#include "asset_pack.h"
+#include "audio.h"
+#include "audio_cache.h"
+#include "background_writer.h"
+#include "game.h"
+#include "ghosts.h"
+#include "heatmap.h"
+#include "job_system.h"
+#include "leaderboard.h"
+#include "replay.h"
+#include "rewind.h"
+#include "rollback.h"
+#include "spectator_stream.h"
+#include "video_export.h"
 
 using namespace std;
 
@@ -16,20 +36,28 @@ using namespace std;
 #define SNAKE_SIZE 20
 #define INITIAL_SNAKE_LENGTH 3
 #define SNAKE_SPEED 7
+#define IDLE_WAIT_MS 500
+#define REWIND_SECONDS 10
+#define HIGH_SCORE_FILE "highest_score.txt"
+#define AUDIO_SETTINGS_FILE "audio_settings.txt"
+#define LEADERBOARD_FILE "leaderboard.log"
+#define SAVE_GAME_FILE "savegame.bin"
+#define REPLAY_DIRECTORY "replays"
+#define SCREENSHOT_DIRECTORY "screenshots"
+#define ARENA_WORLD_COLS 216
+#define ARENA_WORLD_ROWS 136
+#define ARENA_AI_SNAKES 40
+#define ARENA_FOOD_COUNT 60
+#define VERSUS_LATENCY_MS 100
 
 enum GameState{
     MAIN_MENU,
     GAMEPLAY,
     GAME_OVER,
-    INSTRUCTIONS
-};
-
-struct SnakeSegment{
-    int x, y;
-};
-
-struct Food{
-    int x, y;
+    INSTRUCTIONS,
+    ARENA,
+    SPECTATE,
+    VERSUS
 };
 
 struct Button{
@@ -38,7 +66,52 @@ struct Button{
     bool isHovered;
 };
 
-bool initializeSDL(SDL_Window** window, SDL_Renderer** renderer){
+enum AssetKind{
+    ASSET_FONT,
+    ASSET_IMAGE,
+    ASSET_SOUND
+};
+
+// One asset decoded on a worker thread. Only the texture upload for images
+// is left for the render thread.
+struct AssetLoad{
+    AssetKind kind;
+    string path;
+    TTF_Font* font;
+    SDL_Surface* surface;
+    Mix_Chunk* chunk;
+    string error;
+    MappedFile cacheMapping;    // Backs chunk when it came from the audio cache
+    const AssetPack* pack;
+    Job job;
+};
+
+// F12 draws the next frame into this texture as well as the window and
+// reads it back one frame later, once the GPU is long done with it, so the
+// tick never waits on rendering in flight. PNG encoding runs as a job and
+// the background writer saves the file.
+struct Screenshot{
+    SDL_Texture* texture;
+    bool requested;         // Capture the next animated frame
+    bool capturing;         // The frame being drawn goes to the texture
+    bool drawn;             // The texture holds a frame not yet read back
+    int count;
+    vector<uint8_t> pixels;
+    string path;
+    string png;
+    string error;
+    JobGroup group;         // The encode job, which owns pixels while it runs
+    Job job;
+    BackgroundWriter* writer;
+};
+
+// A static screen composed once into a target texture and reused until invalidated
+struct ScreenCache{
+    SDL_Texture* texture;
+    bool valid;
+};
+
+bool initializeSDL(SDL_Window** window, SDL_Renderer** renderer, int audioBufferFrames){
     if (SDL_Init(SDL_INIT_EVERYTHING) != 0){
         cout << "SDL initialization failed: \n" << SDL_GetError() << endl;
         return false;
@@ -54,7 +127,7 @@ bool initializeSDL(SDL_Window** window, SDL_Renderer** renderer){
         return false;
     }
 
-    if (Mix_OpenAudio(44100, MIX_DEFAULT_FORMAT, 2, 2048) < 0) {
+    if (!openAudioDevice(audioBufferFrames, AUDIO_SETTINGS_FILE)) {
         cout << "SDL_mixer initialization failed: \n" << Mix_GetError() << endl;
         return false;
     }
@@ -72,7 +145,7 @@ bool initializeSDL(SDL_Window** window, SDL_Renderer** renderer){
 
     *renderer = SDL_CreateRenderer(*window,
                                    -1,
-                                   SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+                                   SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC | SDL_RENDERER_TARGETTEXTURE);
     if (*renderer == NULL) {
         cout << "Renderer Creation Failed: \n" << SDL_GetError() << endl;
         return false;
@@ -81,110 +154,349 @@ bool initializeSDL(SDL_Window** window, SDL_Renderer** renderer){
     return true;
 }
 
-SDL_Texture* loadTexture(const string &path, SDL_Renderer* renderer){
-    SDL_Texture* newTexture = NULL;
-    SDL_Surface* loadedSurface = IMG_Load(path.c_str());
-    if (loadedSurface == NULL) {
-        cout << "Unable to load image " << path << " SDL_image Error: " << IMG_GetError() << endl;
-    } else {
-        newTexture = SDL_CreateTextureFromSurface(renderer, loadedSurface);
-        if (newTexture == NULL) {
-            cout << "Unable to create texture from " << path << " SDL Error: " << SDL_GetError() << endl;
-        }
-        SDL_FreeSurface(loadedSurface);
+// Runs on a job worker. SDL errors are per thread, so the message is kept
+// for the main thread to report.
+void decodeAsset(void* data){
+    AssetLoad* asset = (AssetLoad*)data;
+    SDL_RWops* source = openAsset(*asset->pack, asset->path);
+    if (source == NULL) {
+        asset->error = SDL_GetError();
+        return;
+    }
+
+    switch (asset->kind) {
+        case ASSET_FONT:
+            asset->font = TTF_OpenFontRW(source, 1, 40);
+            if (asset->font == NULL) {
+                asset->error = TTF_GetError();
+            }
+            break;
+        case ASSET_IMAGE:
+            asset->surface = IMG_Load_RW(source, 1);
+            if (asset->surface == NULL) {
+                asset->error = IMG_GetError();
+            }
+            break;
+        case ASSET_SOUND:
+            asset->chunk = loadSoundCached(source, asset->cacheMapping, asset->error);
+            break;
     }
+}
+
+// Every field but the kind and name starts out zero
+AssetLoad makeAssetLoad(AssetKind kind, const char* path){
+    AssetLoad asset = AssetLoad();
+    asset.kind = kind;
+    asset.path = path;
+    return asset;
+}
+
+void submitAssetLoad(JobSystem* jobs, JobGroup& group, AssetLoad& asset, const AssetPack& pack){
+    asset.pack = &pack;
+    asset.job.function = decodeAsset;
+    asset.job.data = &asset;
+    asset.job.group = &group;
+    submitJob(jobs, &asset.job);
+}
+
+// Turns a decoded image into a texture on the render thread and frees the surface
+SDL_Texture* uploadTexture(AssetLoad& asset, SDL_Renderer* renderer){
+    if (asset.surface == NULL) {
+        cout << "Unable to load image " << asset.path << " SDL_image Error: " << asset.error << endl;
+        return NULL;
+    }
+    SDL_Texture* newTexture = SDL_CreateTextureFromSurface(renderer, asset.surface);
+    if (newTexture == NULL) {
+        cout << "Unable to create texture from " << asset.path << " SDL Error: " << SDL_GetError() << endl;
+    }
+    SDL_FreeSurface(asset.surface);
+    asset.surface = NULL;
     return newTexture;
 }
 
-void drawSnake(SDL_Renderer* renderer, vector<SnakeSegment>& snake) {
-    for (size_t i = 0; i < snake.size(); ++i) {
-        SDL_Rect segmentRect = { snake[i].x, snake[i].y, SNAKE_SIZE, SNAKE_SIZE };
+// Runs on a job worker
+void encodeScreenshot(void* data){
+    Screenshot* shot = (Screenshot*)data;
+    if (encodePng(shot->pixels.data(), SCREEN_WIDTH, SCREEN_HEIGHT, shot->png, shot->error)) {
+        queueFileReplace(*shot->writer, shot->path, shot->png);
+    } else {
+        cout << "Screenshot " << shot->path << " failed: " << shot->error << endl;
+    }
+}
 
-        if (i == 0) {
-            // Head of the snake
-            SDL_SetRenderDrawColor(renderer, 0, 0, 255, 255); // Blue
-            SDL_RenderFillRect(renderer, &segmentRect);
+// Reads the drawn capture back and hands it to an encode job; the previous encode must be done
+void readBackScreenshot(SDL_Renderer* renderer, JobSystem* jobs, Screenshot& shot){
+    SDL_SetRenderTarget(renderer, shot.texture);
+    shot.pixels.resize(SCREEN_WIDTH * SCREEN_HEIGHT * 4);
+    SDL_RenderReadPixels(renderer, NULL, SDL_PIXELFORMAT_ARGB8888, shot.pixels.data(), SCREEN_WIDTH * 4);
+    SDL_SetRenderTarget(renderer, NULL);
+    shot.path = string(SCREENSHOT_DIRECTORY) + "/shot_" + to_string((long long)time(0)) + "_" +
+                to_string(shot.count++) + ".png";
+    shot.job.function = encodeScreenshot;
+    shot.job.data = &shot;
+    shot.job.group = &shot.group;
+    submitJob(jobs, &shot.job);
+    shot.drawn = false;
+}
 
-            // Draw a dot in the middle of the head
-            SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255); // White
-            int dotSize = SNAKE_SIZE / 4;
-            SDL_Rect dotRect = { snake[i].x + SNAKE_SIZE / 2 - dotSize / 2,
-                                 snake[i].y + SNAKE_SIZE / 2 - dotSize / 2,
-                                 dotSize, dotSize };
-            SDL_RenderFillRect(renderer, &dotRect);
-        } else {
-            // Body of the snake
-            SDL_SetRenderDrawColor(renderer, 0, 255, 0, 255); // Green
-            SDL_RenderFillRect(renderer, &segmentRect);
-        }
+// Reads a drawn capture back once the previous encode is done; never waits.
+// Static screens call it while idle, so a capture drawn in a state being
+// left is not held until the next animated frame.
+void pollScreenshot(SDL_Renderer* renderer, JobSystem* jobs, Screenshot& shot){
+    if (shot.drawn && shot.group.pending.load() == 0) {
+        readBackScreenshot(renderer, jobs, shot);
     }
 }
 
-void drawFood(SDL_Renderer* renderer, Food& food) {
-    SDL_Rect foodRect = { food.x, food.y, SNAKE_SIZE, SNAKE_SIZE };
-    SDL_SetRenderDrawColor(renderer, 255, 0, 0, 255); // Red color for food
-    SDL_RenderFillRect(renderer, &foodRect);
+// Call before shutting down: waits for the encoder so a drawn capture is
+// still saved, and drops a request not yet drawn
+void flushScreenshot(SDL_Renderer* renderer, JobSystem* jobs, Screenshot& shot){
+    shot.requested = false;
+    if (!shot.drawn) {
+        return;
+    }
+    waitForJobGroup(jobs, shot.group);
+    readBackScreenshot(renderer, jobs, shot);
 }
 
-void moveSnake(vector<SnakeSegment>& snake, char direction, bool grow) {
-    int newX = snake.front().x;
-    int newY = snake.front().y;
+// Call before drawing an animated frame
+void beginScreenshotFrame(SDL_Renderer* renderer, JobSystem* jobs, Screenshot& shot){
+    if (shot.texture == NULL || shot.group.pending.load() > 0) {
+        return;
+    }
+    if (shot.drawn) {
+        readBackScreenshot(renderer, jobs, shot);
+    }
+    if (shot.requested && shot.group.pending.load() == 0) {
+        shot.requested = false;
+        shot.capturing = true;
+    }
+    SDL_SetRenderTarget(renderer, shot.capturing ? shot.texture : NULL);
+}
 
-    switch (direction) {
-        case 'U':
-            newY -= SNAKE_SIZE;
-            break;
-        case 'D':
-            newY += SNAKE_SIZE;
-            break;
-        case 'L':
-            newX -= SNAKE_SIZE;
-            break;
-        case 'R':
-            newX += SNAKE_SIZE;
-            break;
-        default:
-            break;
+// Call after drawing an animated frame, before presenting it
+void endScreenshotFrame(SDL_Renderer* renderer, Screenshot& shot){
+    if (!shot.capturing) {
+        return;
     }
+    SDL_SetRenderTarget(renderer, NULL);
+    SDL_RenderCopy(renderer, shot.texture, NULL, NULL);
+    shot.capturing = false;
+    shot.drawn = true;
+}
 
-    snake.insert(snake.begin(), {newX, newY});
+void renderLoadingScreen(SDL_Renderer* renderer, int loaded, int total){
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255); // Black background
+    SDL_RenderClear(renderer);
 
-    if (!grow) {
-        snake.pop_back();
+    // No font yet, so progress is a plain bar
+    SDL_Rect frame = { SCREEN_WIDTH / 2 - 200, SCREEN_HEIGHT / 2 - 15, 400, 30 };
+    SDL_Rect fill = { frame.x + 4, frame.y + 4, (frame.w - 8) * loaded / total, frame.h - 8 };
+    SDL_SetRenderDrawColor(renderer, 0, 255, 0, 255); // Green, like the snake
+    SDL_RenderFillRect(renderer, &fill);
+    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255); // White border
+    SDL_RenderDrawRect(renderer, &frame);
+}
+
+ScreenCache createScreenCache(SDL_Renderer* renderer){
+    ScreenCache cache = { NULL, false };
+    cache.texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET,
+                                      SCREEN_WIDTH, SCREEN_HEIGHT);
+    if (cache.texture == NULL) {
+        cout << "Screen cache unavailable, drawing directly: " << SDL_GetError() << endl;
     }
+    return cache;
 }
 
-bool checkFoodCollision(vector<SnakeSegment>& snake, Food& food) {
-    return (snake.front().x == food.x && snake.front().y == food.y);
+// The body goes out in one batched fill; alpha below 255 draws a
+// translucent snake such as the racing ghost
+void drawSnake(SDL_Renderer* renderer, const deque<SnakeSegment>& snake, Uint8 alpha) {
+    if (snake.empty()) {
+        return;
+    }
+    SDL_SetRenderDrawBlendMode(renderer, alpha < 255 ? SDL_BLENDMODE_BLEND : SDL_BLENDMODE_NONE);
+
+    // Body of the snake
+    static vector<SDL_Rect> body;
+    body.clear();
+    for (auto it = snake.begin() + 1; it != snake.end(); ++it) {
+        SDL_Rect segmentRect = { it->x * SNAKE_SIZE, it->y * SNAKE_SIZE, SNAKE_SIZE, SNAKE_SIZE };
+        body.push_back(segmentRect);
+    }
+    SDL_SetRenderDrawColor(renderer, 0, 255, 0, alpha); // Green
+    SDL_RenderFillRects(renderer, body.data(), (int)body.size());
+
+    // Head of the snake
+    SDL_Rect headRect = { snake.front().x * SNAKE_SIZE, snake.front().y * SNAKE_SIZE, SNAKE_SIZE, SNAKE_SIZE };
+    SDL_SetRenderDrawColor(renderer, 0, 0, 255, alpha); // Blue
+    SDL_RenderFillRect(renderer, &headRect);
+
+    // Draw a dot in the middle of the head
+    SDL_SetRenderDrawColor(renderer, 255, 255, 255, alpha); // White
+    int dotSize = SNAKE_SIZE / 4;
+    SDL_Rect dotRect = { headRect.x + SNAKE_SIZE / 2 - dotSize / 2,
+                         headRect.y + SNAKE_SIZE / 2 - dotSize / 2,
+                         dotSize, dotSize };
+    SDL_RenderFillRect(renderer, &dotRect);
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
 }
 
-void repositionFood(Food& food) {
-    food.x = (rand() % (SCREEN_WIDTH / SNAKE_SIZE)) * SNAKE_SIZE;
-    food.y = (rand() % (SCREEN_HEIGHT / SNAKE_SIZE)) * SNAKE_SIZE;
+void drawFood(SDL_Renderer* renderer, const Food& food) {
+    SDL_Rect foodRect = { food.x * SNAKE_SIZE, food.y * SNAKE_SIZE, SNAKE_SIZE, SNAKE_SIZE };
+    SDL_SetRenderDrawColor(renderer, 255, 0, 0, 255); // Red color for food
+    SDL_RenderFillRect(renderer, &foodRect);
 }
 
-bool checkSelfCollision(vector<SnakeSegment>& snake) {
-    int headX = snake.front().x;
-    int headY = snake.front().y;
+// One texel per heatmap cell, stretched over the window when drawn
+SDL_Texture* createHeatmapTexture(SDL_Renderer* renderer){
+    SDL_Texture* texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+                                             HEATMAP_COLS, HEATMAP_ROWS);
+    if (texture == NULL) {
+        cout << "Heatmap overlay unavailable: " << SDL_GetError() << endl;
+        return NULL;
+    }
+    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+    return texture;
+}
 
-    for (size_t i = 1; i < snake.size(); ++i) {
-        if (snake[i].x == headX && snake[i].y == headY) {
-            return true;
+// Visits on a log scale from faint yellow to solid red; cells where snakes
+// died are white, more opaque the more deaths
+void updateHeatmapTexture(SDL_Texture* texture, const Heatmap& heatmap){
+    void* pixels;
+    int pitch;
+    if (SDL_LockTexture(texture, NULL, &pixels, &pitch) != 0) {
+        return;
+    }
+    uint32_t maxVisits = 1, maxDeaths = 1;
+    for (int i = 0; i < HEATMAP_CELLS; ++i) {
+        maxVisits = max(maxVisits, heatmap.visits[i]);
+        maxDeaths = max(maxDeaths, heatmap.deaths[i]);
+    }
+    float visitScale = 1.0f / log1p((float)maxVisits);
+    for (int y = 0; y < HEATMAP_ROWS; ++y) {
+        Uint32* row = (Uint32*)((Uint8*)pixels + y * pitch);
+        for (int x = 0; x < HEATMAP_COLS; ++x) {
+            int cell = y * HEATMAP_COLS + x;
+            Uint32 color = 0;
+            if (heatmap.deaths[cell] > 0) {
+                Uint32 alpha = (Uint32)(120 + 135ull * heatmap.deaths[cell] / maxDeaths);
+                color = alpha << 24 | 0xFFFFFF;
+            } else if (heatmap.visits[cell] > 0) {
+                float heat = log1p((float)heatmap.visits[cell]) * visitScale;
+                Uint32 alpha = (Uint32)(40 + 160 * heat);
+                Uint32 green = (Uint32)(255 * (1.0f - heat));
+                color = alpha << 24 | 0xFF0000 | green << 8;
+            }
+            row[x] = color;
         }
     }
-    return false;
+    SDL_UnlockTexture(texture);
 }
 
-bool checkBorderCollision(vector<SnakeSegment>& snake) {
-    int headX = snake.front().x;
-    int headY = snake.front().y;
+// Draws the part of the arena under the camera. Only chunks that overlap the
+// viewport are visited, so the cost does not depend on the world size.
+void drawArena(SDL_Renderer* renderer, const Arena& arena, int playerIndex) {
+    long long worldWidth = (long long)arena.cols * SNAKE_SIZE;
+    long long worldHeight = (long long)arena.rows * SNAKE_SIZE;
+
+    // Camera follows the player's head; clamp to the world, or centre it when it fits on screen
+    long long cameraX = (worldWidth - SCREEN_WIDTH) / 2;
+    long long cameraY = (worldHeight - SCREEN_HEIGHT) / 2;
+    const ArenaSnake& player = arena.snakes[playerIndex];
+    if (!player.body.empty()) {
+        int64_t head = player.body.front();
+        if (worldWidth > SCREEN_WIDTH) {
+            cameraX = (long long)arenaCellX(arena, head) * SNAKE_SIZE + SNAKE_SIZE / 2 - SCREEN_WIDTH / 2;
+            cameraX = max(0LL, min(cameraX, worldWidth - SCREEN_WIDTH));
+        }
+        if (worldHeight > SCREEN_HEIGHT) {
+            cameraY = (long long)arenaCellY(arena, head) * SNAKE_SIZE + SNAKE_SIZE / 2 - SCREEN_HEIGHT / 2;
+            cameraY = max(0LL, min(cameraY, worldHeight - SCREEN_HEIGHT));
+        }
+    }
 
-    // Check if snake's head is out of bounds
-    if (headX < 0 || headX >= SCREEN_WIDTH || headY < 0 || headY >= SCREEN_HEIGHT) {
-        return true;
+    int firstX = (int)max(0LL, cameraX / SNAKE_SIZE);
+    int firstY = (int)max(0LL, cameraY / SNAKE_SIZE);
+    int lastX = (int)min((long long)arena.cols - 1, (cameraX + SCREEN_WIDTH) / SNAKE_SIZE);
+    int lastY = (int)min((long long)arena.rows - 1, (cameraY + SCREEN_HEIGHT) / SNAKE_SIZE);
+
+    // One fill call per colour instead of one per segment
+    vector<SDL_Rect> playerBody, playerHead, aiBody, aiHeads, foods;
+    for (int chunkY = firstY >> ARENA_CHUNK_SHIFT; chunkY <= lastY >> ARENA_CHUNK_SHIFT; ++chunkY) {
+        for (int chunkX = firstX >> ARENA_CHUNK_SHIFT; chunkX <= lastX >> ARENA_CHUNK_SHIFT; ++chunkX) {
+            const ArenaChunk* chunk = arenaChunkAt(arena, chunkX, chunkY);
+            if (chunk == NULL) {
+                continue;
+            }
+            int fromX = max(firstX, chunkX << ARENA_CHUNK_SHIFT);
+            int toX = min(lastX, ((chunkX + 1) << ARENA_CHUNK_SHIFT) - 1);
+            int fromY = max(firstY, chunkY << ARENA_CHUNK_SHIFT);
+            int toY = min(lastY, ((chunkY + 1) << ARENA_CHUNK_SHIFT) - 1);
+            for (int y = fromY; y <= toY; ++y) {
+                for (int x = fromX; x <= toX; ++x) {
+                    uint32_t owner = chunk->owner[((y & (ARENA_CHUNK_SIZE - 1)) << ARENA_CHUNK_SHIFT) |
+                                                  (x & (ARENA_CHUNK_SIZE - 1))];
+                    if (owner == ARENA_EMPTY) {
+                        continue;
+                    }
+                    SDL_Rect rect = { (int)(x * (long long)SNAKE_SIZE - cameraX),
+                                      (int)(y * (long long)SNAKE_SIZE - cameraY),
+                                      SNAKE_SIZE, SNAKE_SIZE };
+                    if (owner == ARENA_FOOD) {
+                        foods.push_back(rect);
+                        continue;
+                    }
+                    int index = (int)owner - 1;
+                    bool isHead = arena.snakes[index].body.front() == arenaCell(arena, x, y);
+                    if (index == playerIndex) {
+                        (isHead ? playerHead : playerBody).push_back(rect);
+                    } else {
+                        (isHead ? aiHeads : aiBody).push_back(rect);
+                    }
+                }
+            }
+        }
     }
 
-    return false;
+    SDL_SetRenderDrawColor(renderer, 0, 255, 0, 255); // Green, like the single player snake
+    SDL_RenderFillRects(renderer, playerBody.data(), (int)playerBody.size());
+    SDL_SetRenderDrawColor(renderer, 0, 0, 255, 255); // Blue
+    SDL_RenderFillRects(renderer, playerHead.data(), (int)playerHead.size());
+    SDL_SetRenderDrawColor(renderer, 150, 150, 150, 255); // Grey AI bodies
+    SDL_RenderFillRects(renderer, aiBody.data(), (int)aiBody.size());
+    SDL_SetRenderDrawColor(renderer, 255, 140, 0, 255); // Orange AI heads
+    SDL_RenderFillRects(renderer, aiHeads.data(), (int)aiHeads.size());
+    SDL_SetRenderDrawColor(renderer, 255, 0, 0, 255); // Red color for food
+    SDL_RenderFillRects(renderer, foods.data(), (int)foods.size());
+
+    // World edge, so the border the snake can hit is visible
+    SDL_Rect border = { (int)(-cameraX - 1), (int)(-cameraY - 1), (int)(worldWidth + 2), (int)(worldHeight + 2) };
+    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+    SDL_RenderDrawRect(renderer, &border);
+}
+
+// Player one in the single player colours, player two in orange
+void drawVersus(SDL_Renderer* renderer, const VersusGame& game) {
+    static const Uint8 bodyColors[VERSUS_PLAYERS][3] = { { 0, 255, 0 }, { 255, 140, 0 } };
+    static const Uint8 headColors[VERSUS_PLAYERS][3] = { { 0, 0, 255 }, { 255, 255, 0 } };
+    vector<SDL_Rect> body;
+    for (int p = 0; p < VERSUS_PLAYERS; ++p) {
+        body.clear();
+        for (int i = 1; i < game.length[p]; ++i) {
+            int cell = versusSegment(game, p, i);
+            body.push_back({ cell % game.cols * SNAKE_SIZE, cell / game.cols * SNAKE_SIZE, SNAKE_SIZE, SNAKE_SIZE });
+        }
+        SDL_SetRenderDrawColor(renderer, bodyColors[p][0], bodyColors[p][1], bodyColors[p][2], 255);
+        SDL_RenderFillRects(renderer, body.data(), (int)body.size());
+
+        int head = versusSegment(game, p, 0);
+        SDL_Rect headRect = { head % game.cols * SNAKE_SIZE, head / game.cols * SNAKE_SIZE, SNAKE_SIZE, SNAKE_SIZE };
+        SDL_SetRenderDrawColor(renderer, headColors[p][0], headColors[p][1], headColors[p][2], 255);
+        SDL_RenderFillRect(renderer, &headRect);
+    }
+    SDL_Rect foodRect = { game.food % game.cols * SNAKE_SIZE, game.food / game.cols * SNAKE_SIZE, SNAKE_SIZE, SNAKE_SIZE };
+    SDL_SetRenderDrawColor(renderer, 255, 0, 0, 255); // Red color for food
+    SDL_RenderFillRect(renderer, &foodRect);
 }
 
 void renderText(SDL_Renderer* renderer, const std::string& text, int x, int y, TTF_Font* font, SDL_Color color) {
@@ -217,13 +529,40 @@ void renderMainMenu(SDL_Renderer* renderer, TTF_Font* font, std::vector<Button>&
     }
 }
 
-void renderGameOver(SDL_Renderer* renderer, TTF_Font* font, int points, std::vector<Button>& buttons) {
+void renderGameOver(SDL_Renderer* renderer, TTF_Font* font, int points, int highScore, int rank, int playerCount,
+                    std::vector<Button>& buttons) {
     SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255); // Black background
     SDL_RenderClear(renderer);
 
     SDL_Color textColor = {255, 255, 255, 255}; // White color for text
-    renderText(renderer, "Game Over", SCREEN_WIDTH / 2 - 100, SCREEN_HEIGHT / 2 - 100, font, textColor);
-    renderText(renderer, "Score: " + to_string(points), SCREEN_WIDTH / 2 - 100, SCREEN_HEIGHT / 2 - 50, font, textColor);
+    renderText(renderer, "Game Over", SCREEN_WIDTH / 2 - 100, SCREEN_HEIGHT / 2 - 150, font, textColor);
+    renderText(renderer, "Score: " + to_string(points), SCREEN_WIDTH / 2 - 100, SCREEN_HEIGHT / 2 - 100, font, textColor);
+    string bestLine = "Best: " + to_string(highScore);
+    if (rank > 0) {
+        bestLine += "   Rank: " + to_string(rank) + "/" + to_string(playerCount);
+    }
+    renderText(renderer, bestLine, SCREEN_WIDTH / 2 - 100, SCREEN_HEIGHT / 2 - 50, font, textColor);
+
+    for (auto& button : buttons) {
+        renderButton(renderer, button, font);
+    }
+}
+
+// Both scores and who won; versus is not a single player score, so no best or rank
+void renderVersusOver(SDL_Renderer* renderer, TTF_Font* font, const VersusGame& result, std::vector<Button>& buttons) {
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255); // Black background
+    SDL_RenderClear(renderer);
+
+    string winner = "Draw";
+    if (result.alive[0] && !result.alive[1]) {
+        winner = "Player 1 wins";
+    } else if (result.alive[1] && !result.alive[0]) {
+        winner = "Player 2 wins";
+    }
+    SDL_Color textColor = {255, 255, 255, 255}; // White color for text
+    renderText(renderer, winner, SCREEN_WIDTH / 2 - 100, SCREEN_HEIGHT / 2 - 150, font, textColor);
+    renderText(renderer, "P1: " + to_string(result.points[0]) + "   P2: " + to_string(result.points[1]),
+               SCREEN_WIDTH / 2 - 100, SCREEN_HEIGHT / 2 - 100, font, textColor);
 
     for (auto& button : buttons) {
         renderButton(renderer, button, font);
@@ -235,18 +574,46 @@ bool isMouseOverButton(Button& button, int mouseX, int mouseY) {
             mouseY > button.rect.y && mouseY < button.rect.y + button.rect.h);
 }
 
-void resetGame(vector<SnakeSegment>& snake, char& currentDirection, Food& food, int& points) {
-    snake.clear();
-    int initialX = SCREEN_WIDTH / 2;
-    int initialY = SCREEN_HEIGHT / 2;
-    for (int i = 0; i < INITIAL_SNAKE_LENGTH; ++i) {
-        snake.push_back({initialX - i * SNAKE_SIZE, initialY});
+bool updateButtonHover(vector<Button>& buttons, int mouseX, int mouseY) {
+    bool changed = false;
+    for (auto& button : buttons) {
+        bool hovered = isMouseOverButton(button, mouseX, mouseY);
+        if (hovered != button.isHovered) {
+            button.isHovered = hovered;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// Missing or unreadable files count as no high score yet
+int loadHighScore(const string& path) {
+    ifstream file(path.c_str());
+    int highScore = 0;
+    if (!(file >> highScore) || highScore < 0) {
+        highScore = 0;
+    }
+    return highScore;
+}
+
+string replayPath(uint32_t replayId) {
+    return string(REPLAY_DIRECTORY) + "/replay_" + to_string(replayId) + ".rpl";
+}
+
+// Deletes the replays of games the leaderboard no longer keeps, after any
+// pending write of the same file
+void removeDroppedReplays(Leaderboard& leaderboard, BackgroundWriter& writer) {
+    for (uint32_t replayId : leaderboard.droppedReplays) {
+        queueFileRemove(writer, replayPath(replayId));
     }
-    currentDirection = 'R';
-    repositionFood(food);
-    points = 0;
+    leaderboard.droppedReplays.clear();
 }
 
+// The quick-save snapshot, or nothing if there is none yet
+vector<uint8_t> loadSaveGame(const string& path) {
+    ifstream file(path.c_str(), ios::binary);
+    return vector<uint8_t>((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+}
 
 void renderInstructions(SDL_Renderer* renderer, TTF_Font* font){
     SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255); // Black background
@@ -259,61 +626,385 @@ void renderInstructions(SDL_Renderer* renderer, TTF_Font* font){
     renderText(renderer, "2. Eat food to grow the snake and gain points.", 100, 250, font, textColor);
     renderText(renderer, "3. Avoid colliding with the borders or yourself.", 100, 300, font, textColor);
     renderText(renderer, "4. Press ESC to return to the main menu.", 100, 350, font, textColor);
+    renderText(renderer, "5. F5 saves the game, F9 resumes the last save.", 100, 400, font, textColor);
+    renderText(renderer, "6. Hold Backspace to rewind the last few seconds.", 100, 450, font, textColor);
+    renderText(renderer, "7. Press H to show where snakes go and die.", 100, 500, font, textColor);
+    renderText(renderer, "8. Press F12 to save a screenshot.", 100, 550, font, textColor);
+    renderText(renderer, "9. Press V on the menu for two players: arrows and WASD.", 100, 600, font, textColor);
+}
+
+// Plays a replay into a hidden window's target textures, one frame per
+// tick, as fast as frames can be encoded. Two targets take turns so each
+// frame is read back only after the next one has been drawn, and encoding
+// runs on the job system meanwhile.
+int exportReplayVideo(const char* replayFile, const char* outPath, int fps){
+    Replay replay;
+    if (!openReplay(replay, replayFile)) {
+        cout << "Unable to open replay " << replayFile << endl;
+        return 1;
+    }
+    if (SDL_Init(SDL_INIT_VIDEO) != 0 || TTF_Init() == -1 || !IMG_Init(IMG_INIT_JPG | IMG_INIT_PNG)) {
+        cout << "SDL initialization failed: \n" << SDL_GetError() << endl;
+        return 1;
+    }
+    SDL_Window* window = SDL_CreateWindow("Snake Export", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+                                          SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_HIDDEN);
+    SDL_Renderer* renderer = window == NULL ? NULL :
+        SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_TARGETTEXTURE);
+    if (renderer == NULL) {
+        cout << "Renderer Creation Failed: \n" << SDL_GetError() << endl;
+        return 1;
+    }
+
+    AssetPack assetPack = { { NULL, 0 }, NULL, 0 };
+#ifndef EMBED_ASSETS
+    openAssetPack(assetPack, "assets.pak");
+#endif
+    TTF_Font* font = TTF_OpenFontRW(openAsset(assetPack, "font11.ttf"), 1, 40);
+    SDL_Texture* background = IMG_LoadTexture_RW(renderer, openAsset(assetPack, "gameplay.jpg"), 1);
+    SDL_Texture* targets[2];
+    for (auto& target : targets) {
+        target = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET,
+                                   SCREEN_WIDTH, SCREEN_HEIGHT);
+    }
+    if (font == NULL || background == NULL || targets[0] == NULL || targets[1] == NULL) {
+        cout << "Unable to set up export rendering: " << SDL_GetError() << endl;
+        return 1;
+    }
+
+    JobSystem* jobs = createJobSystem(defaultJobWorkerCount());
+    VideoExport video;
+    if (!startVideoExport(video, outPath, SCREEN_WIDTH, SCREEN_HEIGHT, fps, jobs)) {
+        return 1;
+    }
+
+    Game game;
+    ReplayCursor cursor;
+    seekReplay(replay, replay.header->startTick, game, cursor);
+    SDL_Color textColor = {255, 255, 255, 255};
+    Uint64 startCounter = SDL_GetPerformanceCounter();
+    int frame = 0;
+    bool playing = true;
+    while (true) {
+        if (playing) {
+            SDL_SetRenderTarget(renderer, targets[frame & 1]);
+            SDL_RenderCopy(renderer, background, NULL, NULL);
+            drawSnake(renderer, game.snake, 255);
+            drawFood(renderer, game.food);
+            renderText(renderer, "Score: " + to_string(game.points), 10, 10, font, textColor);
+        }
+        // The frame before this one, drawn a whole frame ago
+        if (frame > 0) {
+            SDL_SetRenderTarget(renderer, targets[(frame - 1) & 1]);
+            SDL_RenderReadPixels(renderer, NULL, SDL_PIXELFORMAT_ARGB8888, nextExportFrame(video), SCREEN_WIDTH * 4);
+            submitExportFrame(video);
+        }
+        if (!playing) {
+            break;
+        }
+        frame++;
+        playing = stepReplay(replay, cursor, game);
+    }
+    SDL_SetRenderTarget(renderer, NULL);
+    bool exported = finishVideoExport(video);
+
+    double seconds = (SDL_GetPerformanceCounter() - startCounter) / (double)SDL_GetPerformanceFrequency();
+    cout << "Exported " << video.frameCount << " frames to " << outPath << " in " << seconds << " s ("
+         << video.frameCount / seconds << " fps, " << video.frameCount / seconds / SNAKE_SPEED
+         << "x real time)" << endl;
+
+    destroyJobSystem(jobs);
+    for (auto& target : targets) {
+        SDL_DestroyTexture(target);
+    }
+    SDL_DestroyTexture(background);
+    TTF_CloseFont(font);
+    closeAssetPack(assetPack);
+    closeReplay(replay);
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    IMG_Quit();
+    TTF_Quit();
+    SDL_Quit();
+    return exported ? 0 : 1;
 }
 
 int main(int argc, char* argv[]){
+    if (argc > 1 && string(argv[1]) == "--arena-bench"){
+        int snakeCount = argc > 2 ? atoi(argv[2]) : 1000;
+        int ticks = argc > 3 ? atoi(argv[3]) : 600;
+        int side = argc > 4 ? atoi(argv[4]) : 0;
+        runArenaBenchmark(snakeCount, ticks, side, NULL);
+        return 0;
+    }
+
+    if (argc > 1 && string(argv[1]) == "--jobs-bench"){
+        int maxThreads = argc > 2 ? atoi(argv[2]) : SDL_GetCPUCount();
+        runJobSystemBenchmark(maxThreads);
+        for (int threads = 1; threads <= maxThreads; ++threads) {
+            JobSystem* benchJobs = createJobSystem(threads - 1);
+            runArenaBenchmark(1000, 600, 0, benchJobs);
+            destroyJobSystem(benchJobs);
+        }
+        return 0;
+    }
+
+    if (argc > 1 && string(argv[1]) == "--leaderboard-bench"){
+        int playerCount = argc > 2 ? atoi(argv[2]) : 10000;
+        int gameCount = argc > 3 ? atoi(argv[3]) : 1000000;
+        runLeaderboardBenchmark(playerCount, gameCount);
+        return 0;
+    }
+
+    if (argc > 1 && string(argv[1]) == "--snapshot-bench"){
+        int length = argc > 2 ? atoi(argv[2]) : INITIAL_SNAKE_LENGTH;
+        runSnapshotBenchmark(SCREEN_WIDTH / SNAKE_SIZE, SCREEN_HEIGHT / SNAKE_SIZE, length);
+        return 0;
+    }
+
+    if (argc > 1 && string(argv[1]) == "--replay-bench"){
+        int ticks = argc > 2 ? atoi(argv[2]) : 100000;
+        runReplaySeekBenchmark(SCREEN_WIDTH / SNAKE_SIZE, SCREEN_HEIGHT / SNAKE_SIZE, ticks);
+        return 0;
+    }
+
+    if (argc > 2 && string(argv[1]) == "--ghost-bench"){
+        int count = argc > 3 ? atoi(argv[3]) : GHOST_LIMIT;
+        JobSystem* benchJobs = createJobSystem(defaultJobWorkerCount());
+        runGhostBenchmark(argv[2], count, benchJobs);
+        destroyJobSystem(benchJobs);
+        return 0;
+    }
+
+    if (argc > 1 && string(argv[1]) == "--rollback-bench"){
+        double latency = argc > 2 ? atof(argv[2]) : VERSUS_LATENCY_MS;
+        int loss = argc > 3 ? atoi(argv[3]) : 0;
+        runRollbackBenchmark(latency, loss);
+        return 0;
+    }
+
+    if (argc > 3 && string(argv[1]) == "--export"){
+        int fps = argc > 4 ? max(1, atoi(argv[4])) : SNAKE_SPEED;
+        return exportReplayVideo(argv[2], argv[3], fps);
+    }
+
+    // Arena world size in cells; may be far larger than the window
+    int worldCols = ARENA_WORLD_COLS;
+    int worldRows = ARENA_WORLD_ROWS;
+    for (int i = 1; i + 2 < argc; ++i) {
+        if (string(argv[i]) == "--world") {
+            worldCols = max(1, atoi(argv[i + 1]));
+            worldRows = max(1, atoi(argv[i + 2]));
+        }
+    }
+
+    Uint64 startCounter = SDL_GetPerformanceCounter();
     SDL_Window* window = NULL;
     SDL_Renderer* renderer = NULL;
 
-    if (!initializeSDL(&window, &renderer)){
+    // --audio-buffer N forces a mixer buffer size, --audio-probe measures the device again
+    // instead of using the size cached from last time, --audio-latency measures sound delay,
+    // --player NAME is who finished games are recorded for on the leaderboard,
+    // --heatmap FILE starts the overlay from a heatmap saved by replay_stats,
+    // --spectate FILE makes Spectate play a replay or archive instead of the leaderboard's best,
+    // --stream [PORT] publishes the classic game to spectate_client and other local tools,
+    // --net-latency MS and --net-loss PERCENT shape the simulated link between versus players
+    int audioBuffer = 0;
+    int streamPort = 0;
+    double netLatency = VERSUS_LATENCY_MS;
+    int netLoss = 0;
+    string playerName = "player";
+    string heatmapPath;
+    string spectatePath;
+    for (int i = 1; i < argc; ++i) {
+        if (string(argv[i]) == "--audio-buffer" && i + 1 < argc) {
+            audioBuffer = atoi(argv[i + 1]);
+        } else if (string(argv[i]) == "--audio-probe") {
+            audioBuffer = AUDIO_PROBE;
+        } else if (string(argv[i]) == "--audio-latency") {
+            enableAudioLatencyProbe(true);
+        } else if (string(argv[i]) == "--player" && i + 1 < argc) {
+            playerName = leaderboardName(argv[i + 1]);     // As stored, so lookups by it match
+        } else if (string(argv[i]) == "--heatmap" && i + 1 < argc) {
+            heatmapPath = argv[i + 1];
+        } else if (string(argv[i]) == "--spectate" && i + 1 < argc) {
+            spectatePath = argv[i + 1];
+        } else if (string(argv[i]) == "--stream") {
+            streamPort = i + 1 < argc && atoi(argv[i + 1]) > 0 ? atoi(argv[i + 1]) : SPECTATOR_PORT;
+        } else if (string(argv[i]) == "--net-latency" && i + 1 < argc) {
+            netLatency = atof(argv[i + 1]);
+        } else if (string(argv[i]) == "--net-loss" && i + 1 < argc) {
+            netLoss = atoi(argv[i + 1]);
+        }
+    }
+
+    if (!initializeSDL(&window, &renderer, audioBuffer)){
         return 1;
     }
 
-    TTF_Font* font = TTF_OpenFont("font11.ttf", 40);
+    JobSystem* jobs = createJobSystem(defaultJobWorkerCount());
+
+    // One mapping of assets.pak serves every asset; loose files are the fallback.
+    // Embedded builds carry the assets in the executable and never look at the disk.
+    AssetPack assetPack = { { NULL, 0 }, NULL, 0 };
+#ifndef EMBED_ASSETS
+    if (openAssetPack(assetPack, "assets.pak")) {
+        cout << "Loading " << assetPack.entryCount << " assets from assets.pak" << endl;
+    }
+#endif
+
+    // Decode every asset in parallel on the job system while the main
+    // thread keeps the window alive with a loading screen
+    AssetLoad fontAsset = makeAssetLoad(ASSET_FONT, "font11.ttf");
+    AssetLoad mainMenuAsset = makeAssetLoad(ASSET_IMAGE, "mainmenu.jpg");
+    AssetLoad gameplayAsset = makeAssetLoad(ASSET_IMAGE, "gameplay.jpg");
+    AssetLoad eatAsset = makeAssetLoad(ASSET_SOUND, "eat.mp3");
+    AssetLoad gameOverAsset = makeAssetLoad(ASSET_SOUND, "gOver.wav");
+    // Largest first, so the long decode starts while the rest run beside it
+    AssetLoad* assets[] = { &gameOverAsset, &mainMenuAsset, &gameplayAsset, &eatAsset, &fontAsset };
+    const int assetCount = sizeof(assets) / sizeof(assets[0]);
+
+    JobGroup assetGroup;
+    for (int i = 0; i < assetCount; ++i) {
+        submitAssetLoad(jobs, assetGroup, *assets[i], assetPack);
+    }
+
+    bool quitWhileLoading = false;
+    SDL_Event loadingEvent;
+    while (assetGroup.pending.load() > 0) {
+        while (SDL_PollEvent(&loadingEvent)) {
+            if (loadingEvent.type == SDL_QUIT) {
+                quitWhileLoading = true;
+            }
+        }
+        renderLoadingScreen(renderer, assetCount - assetGroup.pending.load(), assetCount);
+        SDL_RenderPresent(renderer);
+        SDL_Delay(1);
+    }
+    waitForJobGroup(jobs, assetGroup);
+    double decodeMs = (SDL_GetPerformanceCounter() - startCounter) * 1000.0 / SDL_GetPerformanceFrequency();
+
+    TTF_Font* font = fontAsset.font;
     if (!font){
-        cout << "Font loading failed: \n" << TTF_GetError() << endl;
+        cout << "Font loading failed: \n" << fontAsset.error << endl;
         return 1;
     }
 
-    SDL_Texture* mainMenuBackground = loadTexture("mainmenu.jpg", renderer);
+    SDL_Texture* mainMenuBackground = uploadTexture(mainMenuAsset, renderer);
     if (!mainMenuBackground){
         return 1;
     }
 
-    SDL_Texture* gameplayBackground = loadTexture("gameplay.jpg", renderer);
+    SDL_Texture* gameplayBackground = uploadTexture(gameplayAsset, renderer);
     if (!gameplayBackground){
         return 1;
     }
 
-    Mix_Chunk* eatSound = Mix_LoadWAV("eat.mp3");
+    Mix_Chunk* eatSound = eatAsset.chunk;
     if (!eatSound){
-        cout << "Failed to load eat sound effect: " << Mix_GetError() << endl;
+        cout << "Failed to load eat sound effect: " << eatAsset.error << endl;
         return 1;
     }
-    Mix_Chunk* gameOverEffect = Mix_LoadWAV("gOver.wav");
+    Mix_Chunk* gameOverEffect = gameOverAsset.chunk;
     if(!gameOverEffect){
-        cout << "Failed to load game over sound effect: " << Mix_GetError() << endl;
+        cout << "Failed to load game over sound effect: " << gameOverAsset.error << endl;
     }
 
-    srand(time(0)); // Seed the random number generator
-
-    vector<SnakeSegment> snake;
-    Food food;
-    char currentDirection = 'R';
+    // Eats are frequent and cheap to lose; game over always gets a voice
+    SoundDefinition sounds[SOUND_COUNT] = {
+        { eatSound, 1, 2 },
+        { gameOverEffect, 10, 1 }
+    };
+    AudioDispatcher audioDispatcher;
+    startAudioDispatcher(audioDispatcher, sounds);
+
+    // Read once here; after that only the background writer touches the file
+    int highScore = loadHighScore(HIGH_SCORE_FILE);
+    BackgroundWriter writer;
+    startBackgroundWriter(writer);
+    Leaderboard leaderboard;
+    loadLeaderboard(leaderboard, LEADERBOARD_FILE, &writer);
+    removeDroppedReplays(leaderboard, writer);
+    int playerRank = 0;
+    makeDirectory(REPLAY_DIRECTORY);
+    makeDirectory(SCREENSHOT_DIRECTORY);
+
+    // The classic game, one cell per SNAKE_SIZE pixels of the window
+    Game game;
+    initGame(game, SCREEN_WIDTH / SNAKE_SIZE, SCREEN_HEIGHT / SNAKE_SIZE, INITIAL_SNAKE_LENGTH, (uint32_t)time(0));
+    vector<uint8_t> quickSave = loadSaveGame(SAVE_GAME_FILE);
     int points = 0;
-
-    resetGame(snake, currentDirection, food, points);
+    // Keyframes once a second, deltas for every tick in between
+    RewindBuffer rewindBuffer;
+    resetRewind(rewindBuffer, game, REWIND_SECONDS * SNAKE_SPEED, SNAKE_SPEED);
+    bool rewinding = false;
+    // Every classic game is recorded and saved under its leaderboard replay id
+    ReplayRecorder replayRecorder;
+    startReplayRecording(replayRecorder, game, REPLAY_KEYFRAME_INTERVAL);
+    string finishedReplay;
+
+    // Live games add to the heatmap on top of whatever was loaded; H toggles the overlay
+    Heatmap heatmap;
+    clearHeatmap(heatmap);
+    if (!heatmapPath.empty() && !loadHeatmap(heatmap, heatmapPath)) {
+        cout << "Unable to load heatmap " << heatmapPath << endl;
+    }
+    SDL_Texture* heatmapTexture = createHeatmapTexture(renderer);
+    bool showHeatmap = false;
+
+    // Ghost Race plays the player's best replay beside the live game, one
+    // tick each, streamed from disk through the reader's fixed buffer
+    ReplayReader ghostReader;
+    Game ghost;
+    bool ghostActive = false;
+    string ghostPath;
+
+    // Spectate plays up to GHOST_LIMIT replays at once, looping when all have ended
+    GhostSet spectators;
+    initGhosts(spectators, jobs, SNAKE_SIZE, 96);
+    double ghostDrawMs = 0;
+
+    // Versus runs each player's rollback session as if on its own machine,
+    // talking over a loopback link with the latency and loss asked for.
+    // The window shows player one's side.
+    LoopbackLink versusLink;
+    LoopbackEnd versusEnds[VERSUS_PLAYERS] = { { &versusLink, 0 }, { &versusLink, 1 } };
+    vector<RollbackSession> versusSessions(VERSUS_PLAYERS);    // Large; kept off the stack
+    char versusInputs[VERSUS_PLAYERS] = { 0, 0 };
+
+    // NULL unless --stream was given; every publish call accepts that
+    SpectatorServer* spectatorServer = streamPort > 0 ? startSpectatorServer(streamPort) : NULL;
+
+    Screenshot screenshot;
+    screenshot.texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET,
+                                           SCREEN_WIDTH, SCREEN_HEIGHT);
+    if (screenshot.texture == NULL) {
+        cout << "Screenshots unavailable: " << SDL_GetError() << endl;
+    }
+    screenshot.requested = screenshot.capturing = screenshot.drawn = false;
+    screenshot.count = 0;
+    screenshot.writer = &writer;
 
     SDL_Event event;
-    bool running = true;
-    bool grow = false;
+    bool running = !quitWhileLoading;
+    bool firstFrameReported = false;
+    uint32_t gameTicks = 0;     // Length and duration of the current game, for the leaderboard
+    int gameLength = 0;
 
     GameState gameState = MAIN_MENU;
+    // The mode the last game was played in; only classic games count for the best score and leaderboard
+    GameState playedState = GAMEPLAY;
+
+    Arena arena;
+    int arenaPlayer = 0;
 
     vector<Button> buttons = {
         {{SCREEN_WIDTH / 2 - 100, SCREEN_HEIGHT / 2 - 50, 200, 50}, "Play Game", false},
-        {{SCREEN_WIDTH / 2 - 100, SCREEN_HEIGHT / 2 + 10, 200, 50}, "Instructions", false},
-        {{SCREEN_WIDTH / 2 - 100, SCREEN_HEIGHT / 2 + 70, 200, 50}, "Exit", false}
+        {{SCREEN_WIDTH / 2 - 100, SCREEN_HEIGHT / 2 + 10, 200, 50}, "Ghost Race", false},
+        {{SCREEN_WIDTH / 2 - 100, SCREEN_HEIGHT / 2 + 70, 200, 50}, "Arena", false},
+        {{SCREEN_WIDTH / 2 - 100, SCREEN_HEIGHT / 2 + 130, 200, 50}, "Spectate", false},
+        {{SCREEN_WIDTH / 2 - 100, SCREEN_HEIGHT / 2 + 190, 200, 50}, "Instructions", false},
+        {{SCREEN_WIDTH / 2 - 100, SCREEN_HEIGHT / 2 + 250, 200, 50}, "Exit", false}
     };
 
     vector<Button> gameOverButtons = {
@@ -321,21 +1012,120 @@ int main(int argc, char* argv[]){
         {{SCREEN_WIDTH / 2 - 100, SCREEN_HEIGHT / 2 + 60, 200, 50}, "Exit", false}
     };
 
+    // Menus, instructions and game over are static: they sleep in
+    // SDL_WaitEventTimeout and only redraw when an event changes what is shown.
+    bool needsRedraw = true;
+    GameState renderedState = gameState;
+
+    // Indexed by GameState; the slots of the animated states are never used
+    ScreenCache screenCaches[7];
+    screenCaches[MAIN_MENU] = createScreenCache(renderer);
+    screenCaches[INSTRUCTIONS] = createScreenCache(renderer);
+    screenCaches[GAME_OVER] = createScreenCache(renderer);
+    screenCaches[GAMEPLAY] = { NULL, false };
+    screenCaches[ARENA] = { NULL, false };
+    screenCaches[SPECTATE] = { NULL, false };
+    screenCaches[VERSUS] = { NULL, false };
+
     while (running){
-        int mouseX, mouseY;
-        SDL_GetMouseState(&mouseX, &mouseY);
+        bool idle = (gameState != GAMEPLAY && gameState != ARENA && gameState != SPECTATE && gameState != VERSUS);
+        bool haveEvent;
+        if (idle && !needsRedraw) {
+            pollScreenshot(renderer, jobs, screenshot);
+            haveEvent = SDL_WaitEventTimeout(&event, IDLE_WAIT_MS) != 0;
+            if (!haveEvent) {
+                continue;
+            }
+        } else {
+            haveEvent = SDL_PollEvent(&event) != 0;
+        }
 
-        while (SDL_PollEvent(&event)){
+        while (haveEvent){
             if (event.type == SDL_QUIT){
                 running = false;
             }
+            else if (event.type == SDL_WINDOWEVENT){
+                if (event.window.event == SDL_WINDOWEVENT_EXPOSED ||
+                    event.window.event == SDL_WINDOWEVENT_RESTORED) {
+                    needsRedraw = true;
+                }
+            }
+            else if (event.type == SDL_RENDER_TARGETS_RESET || event.type == SDL_RENDER_DEVICE_RESET){
+                for (auto& cache : screenCaches) {
+                    cache.valid = false;
+                }
+                needsRedraw = true;
+            }
+            else if (event.type == SDL_MOUSEMOTION){
+                bool hoverChanged = false;
+                if (gameState == MAIN_MENU){
+                    hoverChanged = updateButtonHover(buttons, event.motion.x, event.motion.y);
+                } else if (gameState == GAME_OVER){
+                    hoverChanged = updateButtonHover(gameOverButtons, event.motion.x, event.motion.y);
+                }
+                if (hoverChanged){
+                    screenCaches[gameState].valid = false;
+                    needsRedraw = true;
+                }
+            }
             else if (event.type == SDL_MOUSEBUTTONDOWN && event.button.button == SDL_BUTTON_LEFT){
                 if (gameState == MAIN_MENU){
+                    updateButtonHover(buttons, event.button.x, event.button.y);
                     for (auto& button : buttons){
                         if (button.isHovered){
-                            if (button.text == "Play Game") {
+                            if (button.text == "Play Game" || button.text == "Ghost Race") {
                                 gameState = GAMEPLAY;
-                                resetGame(snake, currentDirection, food, points);
+                                playedState = GAMEPLAY;
+                                initGame(game, SCREEN_WIDTH / SNAKE_SIZE, SCREEN_HEIGHT / SNAKE_SIZE,
+                                         INITIAL_SNAKE_LENGTH, (uint32_t)time(0));
+                                resetRewind(rewindBuffer, game, REWIND_SECONDS * SNAKE_SPEED, SNAKE_SPEED);
+                                startReplayRecording(replayRecorder, game, REPLAY_KEYFRAME_INTERVAL);
+                                publishSpectatorKeyframe(spectatorServer, game);
+                                points = 0;
+
+                                ghostActive = false;
+                                if (button.text == "Ghost Race") {
+                                    auto best = leaderboard.players.find(playerName);
+                                    if (best != leaderboard.players.end() && best->second.replayId != 0) {
+                                        ghostPath = replayPath(best->second.replayId);
+                                        ghostActive = openReplayReader(ghostReader, ghostPath.c_str(), ghost);
+                                    }
+                                    if (!ghostActive) {
+                                        cout << "No best replay to race for " << playerName << " yet" << endl;
+                                    }
+                                }
+                            } else if (button.text == "Arena") {
+                                gameState = ARENA;
+                                playedState = ARENA;
+                                initArena(arena, worldCols, worldRows, ARENA_FOOD_COUNT, (uint32_t)time(0));
+                                arena.jobs = jobs;
+                                arenaPlayer = addArenaSnake(arena, false, INITIAL_SNAKE_LENGTH);
+                                for (int i = 0; i < ARENA_AI_SNAKES; ++i) {
+                                    addArenaSnake(arena, true, INITIAL_SNAKE_LENGTH);
+                                }
+                                points = 0;
+                                gameTicks = 0;
+                            } else if (button.text == "Spectate") {
+                                initGhosts(spectators, jobs, SNAKE_SIZE, 96);
+                                bool archive = spectatePath.size() > 4 &&
+                                               spectatePath.compare(spectatePath.size() - 4, 4, ".rpa") == 0;
+                                if (archive) {
+                                    addGhostArchive(spectators, spectatePath.c_str(), GHOST_LIMIT);
+                                } else if (!spectatePath.empty()) {
+                                    addGhostFile(spectators, spectatePath.c_str());
+                                } else {
+                                    vector<LeaderboardEntry> best = leaderboardTop(leaderboard, GHOST_LIMIT);
+                                    for (const LeaderboardEntry& entry : best) {
+                                        if (entry.replayId != 0) {
+                                            addGhostFile(spectators, replayPath(entry.replayId).c_str());
+                                        }
+                                    }
+                                }
+                                if (spectators.ghosts.empty()) {
+                                    cout << "No replays to spectate yet" << endl;
+                                } else {
+                                    gameState = SPECTATE;
+                                }
                             } else if (button.text == "Instructions") {
                                 gameState = INSTRUCTIONS;
                             } else if (button.text == "Exit") {
@@ -344,11 +1134,11 @@ int main(int argc, char* argv[]){
                         }
                     }
                 } else if (gameState == GAME_OVER){
+                    updateButtonHover(gameOverButtons, event.button.x, event.button.y);
                     for (auto& button : gameOverButtons){
                         if (button.isHovered){
                             if (button.text == "Return Main Menue"){
                                 gameState = MAIN_MENU;
-                                //resetGame(snake, currentDirection, food, points);
                             } else if (button.text == "Exit"){
                                 running = false;
                             }
@@ -356,86 +1146,371 @@ int main(int argc, char* argv[]){
                     }
                 }
             }
+            else if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_F12 && !idle){
+                screenshot.requested = true;
+            }
             else if (event.type == SDL_KEYDOWN && gameState == GAMEPLAY){
                 switch (event.key.keysym.sym) {
-                    case SDLK_UP:
-                        if (currentDirection != 'D')
-                            currentDirection = 'U';
-                        break;
-                    case SDLK_DOWN:
-                        if (currentDirection != 'U')
-                            currentDirection = 'D';
+                    case SDLK_UP: setGameDirection(game, 'U'); break;
+                    case SDLK_DOWN: setGameDirection(game, 'D'); break;
+                    case SDLK_LEFT: setGameDirection(game, 'L'); break;
+                    case SDLK_RIGHT: setGameDirection(game, 'R'); break;
+                    case SDLK_h: showHeatmap = heatmapTexture != NULL && !showHeatmap; break;
+                    case SDLK_F5:
+                        snapshotGame(game, quickSave);
+                        queueFileReplace(writer, SAVE_GAME_FILE, string(quickSave.begin(), quickSave.end()));
                         break;
-                    case SDLK_LEFT:
-                        if (currentDirection != 'R')
-                            currentDirection = 'L';
-                        break;
-                    case SDLK_RIGHT:
-                        if (currentDirection != 'L')
-                            currentDirection = 'R';
-                        break;
-                    default:
+                    case SDLK_F9: {
+                        // Restored aside first, so a save for another board leaves the game alone
+                        Game loaded;
+                        if (!restoreGame(loaded, quickSave.data(), quickSave.size())) {
+                            cout << "No usable saved game in " << SAVE_GAME_FILE << endl;
+                            break;
+                        }
+                        if (loaded.cols != game.cols || loaded.rows != game.rows) {
+                            cout << "The saved game in " << SAVE_GAME_FILE << " is for a " << loaded.cols << "x"
+                                 << loaded.rows << " board, not " << game.cols << "x" << game.rows << endl;
+                            break;
+                        }
+                        game = loaded;
+                        resetRewind(rewindBuffer, game, REWIND_SECONDS * SNAKE_SPEED, SNAKE_SPEED);
+                        startReplayRecording(replayRecorder, game, REPLAY_KEYFRAME_INTERVAL);
+                        publishSpectatorKeyframe(spectatorServer, game);
+                        ghostActive = false;    // The loaded game is not in step with the ghost
+                        points = game.points;
+                        gameTicks = game.tick;
+                        gameLength = (int)game.snake.size();
+                        if (game.over) {
+                            gameState = GAME_OVER;
+                        }
                         break;
+                    }
+                    default: break;
+                }
+            }
+            else if (event.type == SDL_KEYDOWN && gameState == ARENA){
+                switch (event.key.keysym.sym) {
+                    case SDLK_UP: setArenaDirection(arena, arenaPlayer, 'U'); break;
+                    case SDLK_DOWN: setArenaDirection(arena, arenaPlayer, 'D'); break;
+                    case SDLK_LEFT: setArenaDirection(arena, arenaPlayer, 'L'); break;
+                    case SDLK_RIGHT: setArenaDirection(arena, arenaPlayer, 'R'); break;
+                    default: break;
+                }
+            }
+            else if (event.type == SDL_KEYDOWN && gameState == VERSUS){
+                switch (event.key.keysym.sym) {
+                    case SDLK_UP: versusInputs[0] = 'U'; break;
+                    case SDLK_DOWN: versusInputs[0] = 'D'; break;
+                    case SDLK_LEFT: versusInputs[0] = 'L'; break;
+                    case SDLK_RIGHT: versusInputs[0] = 'R'; break;
+                    case SDLK_w: versusInputs[1] = 'U'; break;
+                    case SDLK_s: versusInputs[1] = 'D'; break;
+                    case SDLK_a: versusInputs[1] = 'L'; break;
+                    case SDLK_d: versusInputs[1] = 'R'; break;
+                    case SDLK_ESCAPE: gameState = MAIN_MENU; break;
+                    default: break;
                 }
             }
-            else if (event.type == SDL_KEYDOWN && gameState == INSTRUCTIONS){
+            else if (event.type == SDL_KEYDOWN && gameState == MAIN_MENU && event.key.keysym.sym == SDLK_v){
+                gameState = VERSUS;
+                playedState = VERSUS;
+                uint32_t seed = (uint32_t)time(0);
+                initLoopback(versusLink, netLatency, netLatency / 4, netLoss, seed);
+                for (int p = 0; p < VERSUS_PLAYERS; ++p) {
+                    startRollback(versusSessions[p], p, loopbackTransport(versusEnds[p]),
+                                  SCREEN_WIDTH / SNAKE_SIZE, SCREEN_HEIGHT / SNAKE_SIZE, seed);
+                    versusInputs[p] = 0;
+                }
+                points = 0;
+                gameTicks = 0;
+            }
+            else if (event.type == SDL_KEYDOWN && (gameState == INSTRUCTIONS || gameState == SPECTATE)){
                 if (event.key.keysym.sym == SDLK_ESCAPE){
                     gameState = MAIN_MENU; // Return to main menu on ESC
                 }
             }
-        }
-        // Update button hover states
-        for (auto& button : buttons){
-            button.isHovered = isMouseOverButton(button, mouseX, mouseY);
+            haveEvent = SDL_PollEvent(&event) != 0;
         }
 
-        for (auto& button : gameOverButtons) {
-            button.isHovered = isMouseOverButton(button, mouseX, mouseY);
+        if (!running){
+            break;
         }
 
-        if (gameState == MAIN_MENU){
-            renderMainMenu(renderer, font, buttons, mainMenuBackground);
+        if (gameState == GAMEPLAY && SDL_GetKeyboardState(NULL)[SDL_SCANCODE_BACKSPACE]){
+            // Holding Backspace scrubs back one tick per frame, as far as the buffer goes.
+            // The heatmap goes back with it, so replaying those ticks counts them once.
+            if (game.tick > oldestRewindTick(rewindBuffer)) {
+                removeHeatmapVisit(heatmap, game);
+                rewindTo(rewindBuffer, game.tick - 1, game);
+            }
+            rewinding = true;
+            points = game.points;
         }
         else if (gameState == GAMEPLAY){
-            moveSnake(snake, currentDirection, grow);
-            grow = false;
-
-            if (checkFoodCollision(snake, food)) {
-                repositionFood(food);
-                grow = true;
-                points += 10;
-                Mix_PlayChannel(-1, eatSound, 0); // Play the eat sound effect
+            if (rewinding) {
+                // Play resumes from here; the ticks scrubbed past are gone
+                truncateRewind(rewindBuffer, game.tick);
+                truncateReplayRecording(replayRecorder, game.tick);
+                publishSpectatorKeyframe(spectatorServer, game);
+                rewinding = false;
+                if (ghostActive) {
+                    // Back to the same tick from the ghost's nearest keyframe, not from the start
+                    uint32_t ghostTick = min(ghostReader.header.startTick + game.tick, ghostReader.header.endTick);
+                    ghostActive = seekReplayReader(ghostReader, ghostTick, ghost);
+                }
             }
-
-            if (checkSelfCollision(snake) || checkBorderCollision(snake)) {
+            recordReplayStep(replayRecorder, game);
+            GameEvents events = stepGame(game);
+            if (ghostActive) {
+                stepReplayReader(ghostReader, ghost);
+            }
+            recordRewindTick(rewindBuffer, game);
+            publishSpectatorTick(spectatorServer, game);
+            addHeatmapVisit(heatmap, game);
+            points = game.points;
+            gameTicks = game.tick;
+            gameLength = (int)game.snake.size();
+            if (events.ate) {
+                postSound(audioDispatcher, SOUND_EAT); // Play the eat sound effect
+            }
+            if (events.died) {
+                gameState = GAME_OVER;
+                postSound(audioDispatcher, SOUND_GAME_OVER); // Play Game-Over Effect
+                finishedReplay = finishReplay(replayRecorder, game.tick);
+                addHeatmapDeath(heatmap, game);
+            }
+        }
+        else if (gameState == ARENA){
+            // A dead snake's body is gone after the tick, so take the length first
+            gameLength = (int)arena.snakes[arenaPlayer].body.size();
+            ArenaEvents events = arenaTick(arena, arenaPlayer);
+            points = arena.snakes[arenaPlayer].points;
+            gameTicks++;
+            if (!events.playerDied) {
+                gameLength = (int)arena.snakes[arenaPlayer].body.size();
+            }
+            if (events.playerAte) {
+                postSound(audioDispatcher, SOUND_EAT);
+            }
+            if (events.playerDied) {
                 gameState = GAME_OVER;
-                Mix_PlayChannel(-1, gameOverEffect, 0); // Play Game-Over Effect
+                postSound(audioDispatcher, SOUND_GAME_OVER);
             }
+        }
+        else if (gameState == VERSUS){
+            versusLink.now = SDL_GetTicks();
+            for (int p = 0; p < VERSUS_PLAYERS; ++p) {
+                // A stalled session has not used its input yet
+                if (advanceRollback(versusSessions[p], versusInputs[p])) {
+                    versusInputs[p] = 0;
+                }
+            }
+            const VersusGame& view = versusSessions[0].game;
+            points = view.points[0];
+            gameTicks = view.tick;
+            gameLength = view.length[0];
+            if (rollbackMatchOver(versusSessions[0]) && rollbackMatchOver(versusSessions[1])) {
+                const RollbackSession& session = versusSessions[0];
+                cout << "Versus: " << session.rollbacks << " rollbacks, longest " << session.longestRollback
+                     << " ticks, worst " << session.worstRollbackMs << " ms, " << session.stalls << " stalls" << endl;
+                gameState = GAME_OVER;
+                postSound(audioDispatcher, SOUND_GAME_OVER);
+            }
+        }
+        else if (gameState == SPECTATE){
+            if (!stepGhosts(spectators)) {
+                restartGhosts(spectators);
+                stepGhosts(spectators);
+            }
+        }
+
+        if (gameState != renderedState){
+            // A request not yet drawn belongs to the state being left
+            screenshot.requested = false;
+            pollScreenshot(renderer, jobs, screenshot);
+
+            // Entering a screen: sync hover with wherever the cursor already is
+            int mouseX, mouseY;
+            SDL_GetMouseState(&mouseX, &mouseY);
+            if (gameState == MAIN_MENU){
+                updateButtonHover(buttons, mouseX, mouseY);
+            } else if (gameState == GAME_OVER){
+                updateButtonHover(gameOverButtons, mouseX, mouseY);
+            }
+            if (gameState == GAME_OVER && playedState == GAMEPLAY && points > highScore){
+                highScore = points;
+                queueFileReplace(writer, HIGH_SCORE_FILE, to_string(highScore) + "\n");
+            }
+            if (gameState == GAME_OVER && playedState != GAMEPLAY){
+                playerRank = 0;     // Nothing was recorded, so no rank to show
+            }
+            else if (gameState == GAME_OVER){
+                // The replay is named after the sequence the leaderboard is about to give this game
+                uint32_t replayId = 0;
+                if (!finishedReplay.empty()) {
+                    replayId = leaderboard.nextSequence;
+                    queueFileReplace(writer, replayPath(replayId), finishedReplay);
+                    finishedReplay.clear();
+                }
+                recordLeaderboardGame(leaderboard, playerName, points, gameLength, gameTicks, replayId, &writer);
+                removeDroppedReplays(leaderboard, writer);
+                playerRank = leaderboardRank(leaderboard, playerName);
+            }
+
+            // Hover may have moved and the score is new, so recompose on entry
+            screenCaches[gameState].valid = false;
+            renderedState = gameState;
+            needsRedraw = true;
+        }
+
+        if (gameState == GAMEPLAY || gameState == ARENA || gameState == SPECTATE || gameState == VERSUS){
+            beginScreenshotFrame(renderer, jobs, screenshot);
+        }
 
+        if (gameState == GAMEPLAY){
             SDL_RenderCopy(renderer, gameplayBackground, NULL, NULL); // Render the gameplay background
-            drawSnake(renderer, snake);
-            drawFood(renderer, food);
+            if (showHeatmap) {
+                updateHeatmapTexture(heatmapTexture, heatmap);
+                SDL_RenderCopy(renderer, heatmapTexture, NULL, NULL);
+            }
+            if (ghostActive && !rewinding && !ghost.over) {
+                drawSnake(renderer, ghost.snake, 96);
+            }
+            drawSnake(renderer, game.snake, 255);
+            drawFood(renderer, game.food);
 
             SDL_Color textColor = {255, 255, 255, 255};
-            renderText(renderer, "Score: " + to_string(points), 10, 10, font, textColor);
-        } 
-        else if (gameState == GAME_OVER){
-            renderGameOver(renderer, font, points, gameOverButtons);
+            renderText(renderer, "Score: " + to_string(points) + "   Best: " + to_string(max(points, highScore)),
+                       10, 10, font, textColor);
+
+            endScreenshotFrame(renderer, screenshot);
+            SDL_RenderPresent(renderer);
+            SDL_Delay(1000 / SNAKE_SPEED);
+            continue;
         }
-        else if (gameState == INSTRUCTIONS){
-            renderInstructions(renderer, font);
+        else if (gameState == ARENA){
+            SDL_RenderCopy(renderer, gameplayBackground, NULL, NULL);
+            drawArena(renderer, arena, arenaPlayer);
+
+            SDL_Color textColor = {255, 255, 255, 255};
+            renderText(renderer, "Score: " + to_string(points) + "   Best: " + to_string(max(points, highScore)),
+                       10, 10, font, textColor);
+
+            endScreenshotFrame(renderer, screenshot);
+            SDL_RenderPresent(renderer);
+            SDL_Delay(1000 / SNAKE_SPEED);
+            continue;
         }
+        else if (gameState == VERSUS){
+            SDL_RenderCopy(renderer, gameplayBackground, NULL, NULL);
+            const VersusGame& view = versusSessions[0].game;
+            drawVersus(renderer, view);
+
+            SDL_Color textColor = {255, 255, 255, 255};
+            renderText(renderer, "P1: " + to_string(view.points[0]) + "   P2: " + to_string(view.points[1]) +
+                       "   Rollbacks: " + to_string(versusSessions[0].rollbacks), 10, 10, font, textColor);
+
+            endScreenshotFrame(renderer, screenshot);
+            SDL_RenderPresent(renderer);
+            SDL_Delay(1000 / SNAKE_SPEED);
+            continue;
+        }
+        else if (gameState == SPECTATE){
+            SDL_RenderCopy(renderer, gameplayBackground, NULL, NULL);
+
+            // Every ghost in one call, straight from the buffer stepGhosts filled
+            Uint64 drawStart = SDL_GetPerformanceCounter();
+            SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+            SDL_RenderGeometry(renderer, NULL, spectators.vertices.data(), (int)spectators.vertices.size(),
+                               spectators.indices.data(), spectators.quadCount * 6);
+            SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+            ghostDrawMs = (SDL_GetPerformanceCounter() - drawStart) * 1000.0 / SDL_GetPerformanceFrequency();
+
+            SDL_Color textColor = {255, 255, 255, 255};
+            char drawTime[16];
+            snprintf(drawTime, sizeof(drawTime), "%.2f", ghostDrawMs);
+            renderText(renderer, "Ghosts: " + to_string(spectators.playingCount) + "/" +
+                       to_string(spectators.ghosts.size()) + "   Draw: " + drawTime + " ms",
+                       10, 10, font, textColor);
+
+            endScreenshotFrame(renderer, screenshot);
+            SDL_RenderPresent(renderer);
+            SDL_Delay(1000 / SNAKE_SPEED);
+            continue;
+        }
+
+        if (!needsRedraw){
+            continue;
+        }
+
+        ScreenCache& cache = screenCaches[gameState];
+        if (!cache.valid){
+            bool toCache = cache.texture != NULL && SDL_SetRenderTarget(renderer, cache.texture) == 0;
 
-         SDL_RenderPresent(renderer);
-        SDL_Delay(1000 / SNAKE_SPEED);
+            if (gameState == MAIN_MENU){
+                renderMainMenu(renderer, font, buttons, mainMenuBackground);
+            }
+            else if (gameState == GAME_OVER && playedState == VERSUS){
+                renderVersusOver(renderer, font, versusSessions[0].game, gameOverButtons);
+            }
+            else if (gameState == GAME_OVER){
+                renderGameOver(renderer, font, points, highScore, playerRank, leaderboardPlayerCount(leaderboard),
+                               gameOverButtons);
+            }
+            else if (gameState == INSTRUCTIONS){
+                renderInstructions(renderer, font);
+            }
+
+            if (toCache){
+                SDL_SetRenderTarget(renderer, NULL);
+                cache.valid = true;
+            }
+        }
+        if (cache.valid){
+            SDL_RenderCopy(renderer, cache.texture, NULL, NULL); // Whole screen in one copy
+        }
+
+        SDL_RenderPresent(renderer);
+        needsRedraw = false;
+
+        if (!firstFrameReported){
+            double firstFrameMs = (SDL_GetPerformanceCounter() - startCounter) * 1000.0 / SDL_GetPerformanceFrequency();
+            cout << "Time to first frame: " << firstFrameMs << " ms (assets decoded at " << decodeMs << " ms)" << endl;
+            firstFrameReported = true;
+        }
     }
 
+    flushScreenshot(renderer, jobs, screenshot);
+    for (auto& cache : screenCaches) {
+        if (cache.texture) {
+            SDL_DestroyTexture(cache.texture);
+        }
+    }
+    if (heatmapTexture) {
+        SDL_DestroyTexture(heatmapTexture);
+    }
+    if (screenshot.texture) {
+        SDL_DestroyTexture(screenshot.texture);
+    }
+    stopSpectatorServer(spectatorServer);
+    waitForJobGroup(jobs, screenshot.group);    // Its file must be queued before the writer stops
+    stopBackgroundWriter(writer);
+    stopAudioDispatcher(audioDispatcher);
+    Mix_HaltChannel(-1);
+    reportAudioLatency();
      Mix_FreeChunk(eatSound);
+    if (gameOverEffect) {
+        Mix_FreeChunk(gameOverEffect);
+    }
+    unmapFile(eatAsset.cacheMapping);
+    unmapFile(gameOverAsset.cacheMapping);
     SDL_DestroyTexture(mainMenuBackground);
     SDL_DestroyTexture(gameplayBackground);
+    destroyJobSystem(jobs);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     TTF_CloseFont(font);
+    closeAssetPack(assetPack); // The font read from the mapping until now
     Mix_Quit();
     IMG_Quit();
     TTF_Quit();
@@ -0,0 +1,139 @@
+#include "versus.h"
+
+#include <algorithm>
+
+using namespace std;
+
+static uint32_t nextRandom(VersusGame& game) {
+    game.rng ^= game.rng << 13;
+    game.rng ^= game.rng >> 17;
+    game.rng ^= game.rng << 5;
+    return game.rng;
+}
+
+static void repositionFood(VersusGame& game) {
+    game.food = (uint16_t)(nextRandom(game) % (uint32_t)(game.cols * game.rows));
+}
+
+uint16_t versusSegment(const VersusGame& game, int player, int i) {
+    return game.body[player][(game.head[player] + i) % VERSUS_MAX_CELLS];
+}
+
+bool initVersus(VersusGame& game, int cols, int rows, uint32_t seed) {
+    if (cols < 8 || rows < 1 || cols * rows > VERSUS_MAX_CELLS) {
+        return false;
+    }
+    game.cols = cols;
+    game.rows = rows;
+    // Facing each other from a third of the way in on the middle row
+    int y = rows / 2;
+    for (int p = 0; p < VERSUS_PLAYERS; ++p) {
+        int x = p == 0 ? cols / 3 : cols - 1 - cols / 3;
+        int step = p == 0 ? -1 : 1;
+        game.head[p] = 0;
+        game.length[p] = 3;
+        for (int i = 0; i < 3; ++i) {
+            game.body[p][i] = (uint16_t)(y * cols + x + i * step);
+        }
+        game.direction[p] = p == 0 ? 'R' : 'L';
+        game.grow[p] = false;
+        game.alive[p] = true;
+        game.points[p] = 0;
+    }
+    game.rng = seed != 0 ? seed : 0x9E3779B9u;
+    game.tick = 0;
+    repositionFood(game);
+    return true;
+}
+
+static bool occupied(const VersusGame& game, int cell) {
+    for (int p = 0; p < VERSUS_PLAYERS; ++p) {
+        for (int i = 0; i < game.length[p]; ++i) {
+            if (versusSegment(game, p, i) == cell) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void stepVersus(VersusGame& game, const char inputs[VERSUS_PLAYERS]) {
+    if (versusOver(game)) {
+        game.tick++;    // Ticks still count, so peers keep agreeing on them
+        return;
+    }
+
+    // Every snake moves before any collision is judged, so neither player is favoured
+    int newHeads[VERSUS_PLAYERS];
+    bool droppedTail[VERSUS_PLAYERS];
+    for (int p = 0; p < VERSUS_PLAYERS; ++p) {
+        char want = inputs[p];
+        char now = game.direction[p];
+        if ((want == 'U' && now != 'D') || (want == 'D' && now != 'U') ||
+            (want == 'L' && now != 'R') || (want == 'R' && now != 'L')) {
+            game.direction[p] = want;
+        }
+        int cell = versusSegment(game, p, 0);
+        int x = cell % game.cols, y = cell / game.cols;
+        switch (game.direction[p]) {
+            case 'U': y -= 1; break;
+            case 'D': y += 1; break;
+            case 'L': x -= 1; break;
+            case 'R': x += 1; break;
+            default: break;
+        }
+        newHeads[p] = x < 0 || x >= game.cols || y < 0 || y >= game.rows ? -1 : y * game.cols + x;
+        droppedTail[p] = !game.grow[p];
+        if (droppedTail[p]) {
+            game.length[p]--;   // The cell the tail leaves is free to move into
+        }
+        game.grow[p] = false;
+    }
+
+    bool dies[VERSUS_PLAYERS];
+    for (int p = 0; p < VERSUS_PLAYERS; ++p) {
+        dies[p] = newHeads[p] < 0 || occupied(game, newHeads[p]);
+    }
+    if (newHeads[0] >= 0 && newHeads[0] == newHeads[1]) {
+        dies[0] = dies[1] = true;
+    }
+
+    for (int p = 0; p < VERSUS_PLAYERS; ++p) {
+        if (dies[p]) {
+            game.alive[p] = false;
+            game.length[p] += droppedTail[p];   // A dead snake stays where it was
+            continue;
+        }
+        game.head[p] = (uint16_t)((game.head[p] + VERSUS_MAX_CELLS - 1) % VERSUS_MAX_CELLS);
+        game.body[p][game.head[p]] = (uint16_t)newHeads[p];
+        game.length[p]++;
+        if (newHeads[p] == game.food) {
+            game.grow[p] = true;
+            game.points[p] += 10;
+            repositionFood(game);
+        }
+    }
+    game.tick++;
+}
+
+bool versusOver(const VersusGame& game) {
+    return !game.alive[0] || !game.alive[1];
+}
+
+uint32_t versusChecksum(const VersusGame& game) {
+    uint32_t hash = 2166136261u;
+    auto mix = [&hash](uint32_t value) {
+        hash = (hash ^ value) * 16777619u;
+    };
+    for (int p = 0; p < VERSUS_PLAYERS; ++p) {
+        for (int i = 0; i < game.length[p]; ++i) {
+            mix(versusSegment(game, p, i));
+        }
+        mix((uint32_t)game.direction[p] << 16 | game.grow[p] << 8 | game.alive[p]);
+        mix((uint32_t)game.points[p]);
+    }
+    mix(game.food);
+    mix(game.rng);
+    mix(game.tick);
+    return hash;
+}
@@ -0,0 +1,41 @@
+#ifndef VERSUS_H
+#define VERSUS_H
+
+#include <cstdint>
+
+// Head-to-head classic snake: two snakes, one food. A snake dies on a
+// wall or any body, including the other snake's; two heads meeting kill
+// both. The match ends when either snake is dead.
+//
+// The state is flat, fixed-size data (bodies are ring buffers of cell
+// indexes), so saving and restoring it for rollback is a plain copy.
+
+#define VERSUS_PLAYERS 2
+#define VERSUS_MAX_CELLS 4096       // Largest board the flat state holds
+
+struct VersusGame{
+    int cols, rows;
+    uint16_t body[VERSUS_PLAYERS][VERSUS_MAX_CELLS];    // Cell indexes, a ring buffer per snake
+    uint16_t head[VERSUS_PLAYERS];                      // Slot of the head in body
+    uint16_t length[VERSUS_PLAYERS];
+    char direction[VERSUS_PLAYERS];
+    bool grow[VERSUS_PLAYERS];
+    bool alive[VERSUS_PLAYERS];
+    int points[VERSUS_PLAYERS];
+    uint16_t food;
+    uint32_t rng;
+    uint32_t tick;
+};
+
+// False if the board does not fit in VERSUS_MAX_CELLS
+bool initVersus(VersusGame& game, int cols, int rows, uint32_t seed);
+// inputs[p] is a direction to turn to, or 0 to keep going; reversals are
+// ignored. Once the match is over only the tick advances.
+void stepVersus(VersusGame& game, const char inputs[VERSUS_PLAYERS]);
+bool versusOver(const VersusGame& game);
+// Segment i of a snake (0 is the head) as a cell index
+uint16_t versusSegment(const VersusGame& game, int player, int i);
+// Hash of everything that affects play, for spotting desyncs
+uint32_t versusChecksum(const VersusGame& game);
+
+#endif
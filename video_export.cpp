@@ -0,0 +1,200 @@
+#include "video_export.h"
+
+#include <SDL2/SDL_image.h>
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+using namespace std;
+
+bool savePngFrame(const uint8_t* pixels, int width, int height, const string& path, string& error) {
+    SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormatFrom((void*)pixels, width, height, 32, width * 4,
+                                                              SDL_PIXELFORMAT_ARGB8888);
+    if (surface == NULL) {
+        error = SDL_GetError();
+        return false;
+    }
+    bool saved = IMG_SavePNG(surface, path.c_str()) == 0;
+    if (!saved) {
+        error = IMG_GetError();
+    }
+    SDL_FreeSurface(surface);
+    return saved;
+}
+
+static size_t SDLCALL appendToString(SDL_RWops* context, const void* data, size_t size, size_t count) {
+    ((string*)context->hidden.unknown.data1)->append((const char*)data, size * count);
+    return count;
+}
+
+static Sint64 SDLCALL noSize(SDL_RWops*) {
+    return -1;
+}
+
+static Sint64 SDLCALL noSeek(SDL_RWops*, Sint64, int) {
+    return -1;
+}
+
+static size_t SDLCALL noRead(SDL_RWops*, void*, size_t, size_t) {
+    return 0;
+}
+
+static int SDLCALL noClose(SDL_RWops*) {
+    return 0;
+}
+
+bool encodePng(const uint8_t* pixels, int width, int height, string& png, string& error) {
+    png.clear();
+    SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormatFrom((void*)pixels, width, height, 32, width * 4,
+                                                              SDL_PIXELFORMAT_ARGB8888);
+    SDL_RWops* output = surface == NULL ? NULL : SDL_AllocRW();
+    if (output == NULL) {
+        error = SDL_GetError();
+        SDL_FreeSurface(surface);
+        return false;
+    }
+    // SDL2 has no growable memory RWops, so this one appends every write to png
+    output->size = noSize;
+    output->seek = noSeek;
+    output->read = noRead;
+    output->write = appendToString;
+    output->close = noClose;
+    output->type = SDL_RWOPS_UNKNOWN;
+    output->hidden.unknown.data1 = &png;
+    bool encoded = IMG_SavePNG_RW(surface, output, 0) == 0;
+    if (!encoded) {
+        error = IMG_GetError();
+    }
+    SDL_FreeRW(output);
+    SDL_FreeSurface(surface);
+    return encoded;
+}
+
+static string pngFramePath(const string& path, int index) {
+    string stem = path;
+    if (stem.size() > 4 && stem.compare(stem.size() - 4, 4, ".png") == 0) {
+        stem.resize(stem.size() - 4);
+    }
+    char number[16];
+    snprintf(number, sizeof(number), "_%05d.png", index);
+    return stem + number;
+}
+
+// Full-range BT.601 in 8.8 fixed point; chroma is the average of each 2x2 block
+static void convertToI420(const uint8_t* pixels, int width, int height, uint8_t* planes) {
+    uint8_t* lumaPlane = planes;
+    uint8_t* uPlane = planes + width * height;
+    uint8_t* vPlane = uPlane + (width / 2) * (height / 2);
+    for (int y = 0; y < height; y += 2) {
+        const uint32_t* rows[2] = { (const uint32_t*)(pixels + y * width * 4),
+                                    (const uint32_t*)(pixels + (y + 1) * width * 4) };
+        for (int x = 0; x < width; x += 2) {
+            int r = 0, g = 0, b = 0;
+            for (int dy = 0; dy < 2; ++dy) {
+                for (int dx = 0; dx < 2; ++dx) {
+                    uint32_t argb = rows[dy][x + dx];
+                    int pr = (argb >> 16) & 0xFF, pg = (argb >> 8) & 0xFF, pb = argb & 0xFF;
+                    lumaPlane[(y + dy) * width + x + dx] = (uint8_t)((77 * pr + 150 * pg + 29 * pb + 128) >> 8);
+                    r += pr;
+                    g += pg;
+                    b += pb;
+                }
+            }
+            // Sums of four pixels, so shift by two more; the bias keeps the numerator positive
+            int u = (-43 * r - 85 * g + 128 * b + (128 << 10) + 512) >> 10;
+            int v = (128 * r - 107 * g - 21 * b + (128 << 10) + 512) >> 10;
+            int chroma = (y / 2) * (width / 2) + x / 2;
+            uPlane[chroma] = (uint8_t)min(255, max(0, u));
+            vPlane[chroma] = (uint8_t)min(255, max(0, v));
+        }
+    }
+}
+
+// Runs on a job worker
+static void encodeExportFrame(void* data) {
+    ExportFrame& frame = *(ExportFrame*)data;
+    const VideoExport& video = *frame.owner;
+    if (video.format == EXPORT_Y4M) {
+        frame.planes.resize(video.width * video.height * 3 / 2);
+        convertToI420(frame.pixels.data(), video.width, video.height, frame.planes.data());
+    } else {
+        savePngFrame(frame.pixels.data(), video.width, video.height, pngFramePath(video.path, frame.index),
+                     frame.error);
+    }
+}
+
+// Waits for the frame in a slot and writes it out; frames must come here in order
+static void flushExportFrame(VideoExport& video, ExportFrame& frame) {
+    if (frame.index < 0) {
+        return;
+    }
+    waitForJobGroup(video.jobs, frame.group);
+    if (!frame.error.empty()) {
+        cout << "Frame " << frame.index << " failed: " << frame.error << endl;
+        frame.error.clear();
+        video.failed = true;
+    } else if (video.format == EXPORT_Y4M) {
+        video.file << "FRAME\n";
+        video.file.write((const char*)frame.planes.data(), (streamsize)frame.planes.size());
+    }
+    frame.index = -1;
+}
+
+bool startVideoExport(VideoExport& video, const string& path, int width, int height, int fps, JobSystem* jobs) {
+    bool y4m = path.size() > 4 && path.compare(path.size() - 4, 4, ".y4m") == 0;
+    video.format = y4m ? EXPORT_Y4M : EXPORT_PNG;
+    video.path = path;
+    video.width = width;
+    video.height = height;
+    video.jobs = jobs;
+    video.frameCount = 0;
+    video.failed = false;
+    for (int i = 0; i < EXPORT_FRAME_SLOTS; ++i) {
+        video.frames[i].index = -1;
+        video.frames[i].owner = &video;
+    }
+    if (!y4m) {
+        return true;
+    }
+    if (width % 2 != 0 || height % 2 != 0) {
+        cout << "Y4M export needs an even frame size, not " << width << "x" << height << endl;
+        return false;
+    }
+    video.file.open(path.c_str(), ios::binary | ios::trunc);
+    if (!video.file) {
+        cout << "Unable to write " << path << endl;
+        return false;
+    }
+    video.file << "YUV4MPEG2 W" << width << " H" << height << " F" << fps << ":1 Ip A1:1 C420jpeg\n";
+    return true;
+}
+
+uint8_t* nextExportFrame(VideoExport& video) {
+    ExportFrame& frame = video.frames[video.frameCount % EXPORT_FRAME_SLOTS];
+    flushExportFrame(video, frame);
+    frame.pixels.resize(video.width * video.height * 4);
+    return frame.pixels.data();
+}
+
+void submitExportFrame(VideoExport& video) {
+    ExportFrame& frame = video.frames[video.frameCount % EXPORT_FRAME_SLOTS];
+    frame.index = video.frameCount++;
+    frame.job.function = encodeExportFrame;
+    frame.job.data = &frame;
+    frame.job.group = &frame.group;
+    submitJob(video.jobs, &frame.job);
+}
+
+bool finishVideoExport(VideoExport& video) {
+    for (int i = max(0, video.frameCount - EXPORT_FRAME_SLOTS); i < video.frameCount; ++i) {
+        flushExportFrame(video, video.frames[i % EXPORT_FRAME_SLOTS]);
+    }
+    if (video.format == EXPORT_Y4M) {
+        video.file.close();
+        if (!video.file) {
+            cout << "Failed writing " << video.path << endl;
+            video.failed = true;
+        }
+    }
+    return !video.failed;
+}
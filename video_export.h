@@ -0,0 +1,63 @@
+#ifndef VIDEO_EXPORT_H
+#define VIDEO_EXPORT_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "job_system.h"
+
+// Turns rendered frames into a raw Y4M stream or a numbered PNG sequence.
+// The caller reads each frame back into the buffer nextExportFrame hands
+// out and submits it; encoding then runs on the job system while the next
+// frames render. Y4M frames are converted in parallel but written in order.
+//
+// Frames are ARGB8888 as SDL_RenderReadPixels returns them, width * 4
+// bytes per row.
+
+#define EXPORT_FRAME_SLOTS 4
+
+enum ExportFormat{
+    EXPORT_Y4M,     // 4:2:0, full range BT.601; width and height must be even
+    EXPORT_PNG      // One file per frame: out.png becomes out_00000.png, out_00001.png, ...
+};
+
+struct VideoExport;
+
+struct ExportFrame{
+    std::vector<uint8_t> pixels;
+    std::vector<uint8_t> planes;    // Y4M only: Y, then U, then V
+    std::string error;
+    int index;                      // -1 when the slot holds no frame
+    JobGroup group;
+    Job job;
+    VideoExport* owner;
+};
+
+struct VideoExport{
+    ExportFormat format;
+    std::string path;               // Y4M file, or the PNG name the frame numbers go into
+    int width, height;
+    std::ofstream file;
+    JobSystem* jobs;
+    ExportFrame frames[EXPORT_FRAME_SLOTS];
+    int frameCount;                 // Submitted so far
+    bool failed;
+};
+
+// The format follows the extension: .y4m is a stream, anything else a PNG sequence
+bool startVideoExport(VideoExport& video, const std::string& path, int width, int height, int fps, JobSystem* jobs);
+// Buffer for the next frame, once the frame that last used it is encoded and written
+uint8_t* nextExportFrame(VideoExport& video);
+// Starts encoding the frame filled since nextExportFrame
+void submitExportFrame(VideoExport& video);
+// Waits for every frame and closes the output; false if any frame failed
+bool finishVideoExport(VideoExport& video);
+
+// Writes one ARGB8888 frame as a PNG; safe on any thread
+bool savePngFrame(const uint8_t* pixels, int width, int height, const std::string& path, std::string& error);
+// Same into memory, for callers that hand the file to a writer of their own
+bool encodePng(const uint8_t* pixels, int width, int height, std::string& png, std::string& error);
+
+#endif